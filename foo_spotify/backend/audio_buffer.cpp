@@ -2,111 +2,399 @@
 
 #include "audio_buffer.h"
 
+#include <fb2k/advanced_config.h>
 #include <utils/abort_manager.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+
+template <typename Limits, typename Counters>
+void AddToHistogram( const Limits& limits, Counters& counters, uint64_t value )
+{
+    const auto bucketIdx = std::distance( limits.cbegin(), std::upper_bound( limits.cbegin(), limits.cend(), value ) );
+    counters[bucketIdx].fetch_add( 1, std::memory_order_relaxed );
+}
+
+} // namespace
+
 namespace sptf
 {
 
 AudioBuffer::AudioBuffer( AbortManager& abortManager )
     : abortManager_( abortManager )
+    , targetChunkDurationMs_( config::advanced::playback_chunk_duration )
 {
 }
 
-bool AudioBuffer::write( AudioChunkHeader header, const uint16_t* data )
+size_t AudioBuffer::write( uint32_t sampleRate, uint16_t channels, const int16_t* data, size_t frameCount )
 {
+    assert( sampleRate && channels );
+
+    if ( !sync_generation() )
+    { // data from the position before the seek: consume it, so that libspotify won't redeliver it
+        return frameCount;
+    }
+
+    if ( hasPendingChunk_
+         && ( pendingHeader_.sampleRate != sampleRate || pendingHeader_.channels != channels ) )
     {
-        std::lock_guard lock( posMutex_ );
+        publish_pending();
+    }
 
-        const size_t readPos = readPos_;
-        const size_t writePos = writePos_;
-        const size_t waterMark = waterMark_;
-        const size_t writeSize = k_headerSizeInU16 + header.size;
+    const auto framesWritten = append( sampleRate, channels, data, frameCount );
+    if ( framesWritten < frameCount || pendingHeader_.size >= pendingTargetSize_ )
+    { // either the chunk is big enough or the buffer is full: in the latter case let consumer drain the data we already have
+        publish_pending();
+    }
 
-        const auto writeData = [&]( size_t writePos ) {
-            const auto curBufferPos = begin_ + writePos;
-            std::copy( &header, &header + 1, reinterpret_cast<AudioChunkHeader*>( curBufferPos ) );
-            std::copy( data, data + header.size, curBufferPos + k_headerSizeInU16 );
-        };
+    return framesWritten;
+}
+
+bool AudioBuffer::write_end()
+{
+    if ( !sync_generation() )
+    {
+        return true;
+    }
+
+    publish_pending();
+    // leave space for a flush marker
+    return publish_marker( AudioChunkHeader::k_flagEof, k_headerSizeInSamples );
+}
+
+void AudioBuffer::write_flush()
+{
+    if ( !sync_generation() )
+    {
+        return;
+    }
+
+    // drop the data that consumer hasn't seen yet
+    hasPendingChunk_ = false;
+    writeEnd_ = writePos_.load( std::memory_order_relaxed );
+
+    if ( isLastChunkFlush_ )
+    { // nothing was published since the last flush
+        return;
+    }
+
+    // `append` and `write_end` always leave enough space for the marker
+    [[maybe_unused]] const auto bRet = publish_marker( AudioChunkHeader::k_flagFlush, 0 );
+    assert( bRet );
+
+    // marker must be visible before the counter
+    flushesWritten_.fetch_add( 1, std::memory_order_release );
+}
+
+bool AudioBuffer::has_data()
+{
+    uint64_t readPos;
+    AudioChunkHeader header;
+    return peek_current_chunk( readPos, header );
+}
+
+bool AudioBuffer::wait_for_data( abort_callback& abort )
+{
+    if ( has_data() )
+    {
+        return true;
+    }
 
-        // TODO: simplify the code
-        if ( writePos >= readPos ) // write leads
+    const auto abortableScope = abortManager_.GetAbortableScope( [&] {
         {
-            if ( size_ - writePos >= writeSize )
-            {
-                writeData( writePos );
-
-                writePos_ = writePos + writeSize;
-                waterMark_ = size_;
-            }
-            else // wrap-around
-            {
-                if ( !readPos || readPos - 1 < writeSize )
-                {
-                    return false;
-                }
-
-                writeData( 0 );
-
-                writePos_ = writeSize;
-                waterMark_ = writePos;
-            }
+            std::lock_guard lock( waitMutex_ );
         }
-        else // read leads
-        {
-            if ( readPos - 1 - writePos < writeSize )
-            {
-                return false;
-            }
+        dataCv_.notify_all();
+    },
+                                                                 abort );
 
-            writeData( writePos );
+    std::unique_lock lock( waitMutex_ );
 
-            writePos_ = writePos + writeSize;
-        }
+    isConsumerWaiting_.store( true, std::memory_order_relaxed );
+    // pairs with the fence in `notify_consumer`
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    dataCv_.wait( lock, [&] {
+        return ( has_data() || abort.is_aborting() );
+    } );
+
+    isConsumerWaiting_.store( false, std::memory_order_relaxed );
+
+    return has_data();
+}
+
+void AudioBuffer::begin_track()
+{
+    start_generation();
+    writableGeneration_.store( generation_.load( std::memory_order_relaxed ), std::memory_order_release );
+    // track load latency is not a seek latency
+    isWaitingForSeekData_ = false;
+}
+
+void AudioBuffer::begin_seek()
+{
+    start_generation();
+    seekStartTime_ = std::chrono::steady_clock::now();
+    isWaitingForSeekData_ = true;
+}
+
+void AudioBuffer::end_seek()
+{
+    // only consumer modifies `writableGeneration_`
+    writableGeneration_.store( generation_.load( std::memory_order_relaxed ), std::memory_order_release );
+}
+
+AudioBuffer::ChunkStats AudioBuffer::get_chunk_stats() const
+{
+    ChunkStats stats;
+    for ( size_t i = 0; i < stats.counts.size(); ++i )
+    {
+        stats.counts[i] = chunkStats_[i].load( std::memory_order_relaxed );
     }
+    return stats;
+}
 
-    dataCv_.notify_all();
-    return true;
+AudioBuffer::SeekStats AudioBuffer::get_seek_stats() const
+{
+    SeekStats stats;
+    for ( size_t i = 0; i < stats.counts.size(); ++i )
+    {
+        stats.counts[i] = seekStats_[i].load( std::memory_order_relaxed );
+    }
+    return stats;
+}
+
+void AudioBuffer::reset_stats()
+{
+    for ( auto& count: chunkStats_ )
+    {
+        count.store( 0, std::memory_order_relaxed );
+    }
+    for ( auto& count: seekStats_ )
+    {
+        count.store( 0, std::memory_order_relaxed );
+    }
 }
 
-void AudioBuffer::write_end()
+void AudioBuffer::start_generation()
 {
-    uint16_t dummy{};
-    write( AudioChunkHeader{ 0, 0, 0, 1 }, &dummy );
+    // only consumer modifies `generation_`
+    generation_.store( generation_.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
 }
 
-bool AudioBuffer::has_data() const
+bool AudioBuffer::sync_generation()
 {
-    std::lock_guard lock( posMutex_ );
+    // `writableGeneration_` is always updated after `generation_` and is loaded before it here,
+    // so equal values mean that no seek is in progress
+    const auto writableGeneration = writableGeneration_.load( std::memory_order_acquire );
+    const auto generation = generation_.load( std::memory_order_acquire );
+    if ( generation != writtenGeneration_ )
+    {
+        writtenGeneration_ = generation;
+
+        // pending data belongs to the previous generation, no point in publishing it
+        hasPendingChunk_ = false;
+        writeEnd_ = writePos_.load( std::memory_order_relaxed );
+    }
 
-    return has_data_no_lock();
+    return ( writableGeneration == generation );
 }
 
-bool AudioBuffer::wait_for_data( abort_callback& abort )
+AudioBuffer::AudioChunkHeader AudioBuffer::make_header( uint8_t flags, uint32_t sampleRate, uint16_t channels ) const
 {
-    const auto abortableScope = abortManager_.GetAbortableScope( [&] { dataCv_.notify_all(); }, abort );
+    AudioChunkHeader header{};
+    header.version = AudioChunkHeader::k_version;
+    header.format = SampleFormat::int16;
+    header.flags = flags;
+    header.channels = channels;
+    header.sampleRate = sampleRate;
+    header.generation = writtenGeneration_;
+    return header;
+}
 
-    std::unique_lock lock( posMutex_ );
-    dataCv_.wait( lock, [&] {
-        return ( has_data_no_lock() || abort.is_aborting() );
-    } );
-    return has_data_no_lock();
+size_t AudioBuffer::append( uint32_t sampleRate, uint16_t channels, const int16_t* data, size_t frameCount )
+{
+    const uint64_t readPos = readPos_.load( std::memory_order_acquire );
+    const size_t freeSize = size_ - static_cast<size_t>( writeEnd_ - readPos );
+    // always keep space for eof and flush markers, so that neither of them can fail after data write
+    const size_t requiredSize = ( hasPendingChunk_ ? 0 : k_headerSizeInSamples ) + 2 * k_headerSizeInSamples;
+    if ( freeSize <= requiredSize )
+    {
+        return 0;
+    }
+
+    // chunk size must fit into `AudioChunkHeader::size`
+    const size_t maxChunkSize = std::numeric_limits<uint32_t>::max() - ( hasPendingChunk_ ? pendingHeader_.size : 0 );
+    const size_t framesToWrite = std::min( frameCount, std::min( freeSize - requiredSize, maxChunkSize ) / channels );
+    if ( !framesToWrite )
+    {
+        return 0;
+    }
+
+    if ( !hasPendingChunk_ )
+    {
+        hasPendingChunk_ = true;
+
+        pendingHeader_ = make_header( 0, sampleRate, channels );
+        pendingTargetSize_ = static_cast<size_t>( sampleRate ) * channels * targetChunkDurationMs_ / 1000;
+
+        // header is written on publish, when the final size is known
+        writeEnd_ += k_headerSizeInSamples;
+    }
+
+    const size_t size = framesToWrite * channels;
+    copy_to_buffer( writeEnd_, data, size );
+    writeEnd_ += size;
+    pendingHeader_.size += static_cast<uint32_t>( size );
+
+    return framesToWrite;
 }
 
-void AudioBuffer::clear()
+void AudioBuffer::publish_pending()
 {
+    if ( !hasPendingChunk_ )
     {
-        std::lock_guard lock( posMutex_ );
+        return;
+    }
+    hasPendingChunk_ = false;
+    isLastChunkFlush_ = false;
 
-        readPos_ = 0;
-        writePos_ = 0;
-        waterMark_ = size_;
+    write_header( writePos_.load( std::memory_order_relaxed ), pendingHeader_ );
+    writePos_.store( writeEnd_, std::memory_order_release );
+
+    update_chunk_stats( pendingHeader_ );
+    notify_consumer();
+}
+
+bool AudioBuffer::publish_marker( uint8_t flags, size_t reservedSize )
+{
+    assert( !hasPendingChunk_ );
+
+    const uint64_t readPos = readPos_.load( std::memory_order_acquire );
+    const size_t freeSize = size_ - static_cast<size_t>( writeEnd_ - readPos );
+    if ( freeSize < k_headerSizeInSamples + reservedSize )
+    {
+        return false;
+    }
+
+    write_header( writeEnd_, make_header( flags ) );
+    writeEnd_ += k_headerSizeInSamples;
+    writePos_.store( writeEnd_, std::memory_order_release );
+
+    isLastChunkFlush_ = ( flags & AudioChunkHeader::k_flagFlush );
+    notify_consumer();
+
+    return true;
+}
+
+void AudioBuffer::write_header( uint64_t pos, const AudioChunkHeader& header )
+{
+    std::array<int16_t, k_headerSizeInSamples> headerData;
+    std::memcpy( headerData.data(), &header, sizeof( header ) );
+    copy_to_buffer( pos, headerData.data(), headerData.size() );
+}
+
+void AudioBuffer::copy_to_buffer( uint64_t pos, const int16_t* data, size_t size )
+{
+    if ( !size )
+    {
+        return;
+    }
+
+    const size_t idx = pos & mask_;
+    const size_t firstSize = std::min( size, size_ - idx );
+    std::copy( data, data + firstSize, begin_ + idx );
+    std::copy( data + firstSize, data + size, begin_ );
+}
+
+void AudioBuffer::notify_consumer()
+{
+    // pairs with the fence in `wait_for_data`:
+    // either consumer sees the new `writePos_` or we see `isConsumerWaiting_`
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( !isConsumerWaiting_.load( std::memory_order_relaxed ) )
+    {
+        return;
+    }
+
+    {
+        // consumer might be between predicate check and actual wait
+        std::lock_guard lock( waitMutex_ );
     }
     dataCv_.notify_all();
 }
 
-bool AudioBuffer::has_data_no_lock() const
+void AudioBuffer::update_chunk_stats( const AudioChunkHeader& header )
+{
+    if ( header.flags || !header.sampleRate || !header.channels )
+    {
+        return;
+    }
+
+    const auto durationMs = static_cast<uint64_t>( header.size ) * 1000 / header.channels / header.sampleRate;
+    AddToHistogram( ChunkStats::k_bucketLimitsInMs, chunkStats_, durationMs );
+}
+
+void AudioBuffer::update_seek_stats()
+{
+    isWaitingForSeekData_ = false;
+
+    const auto latencyMs = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - seekStartTime_ ).count();
+    AddToHistogram( SeekStats::k_bucketLimitsInMs, seekStats_, static_cast<uint64_t>( latencyMs ) );
+}
+
+bool AudioBuffer::peek_chunk( uint64_t& readPos, AudioChunkHeader& header )
+{
+    // only consumer modifies `readPos_`
+    readPos = readPos_.load( std::memory_order_relaxed );
+    const uint64_t writePos = writePos_.load( std::memory_order_acquire );
+    if ( readPos == writePos )
+    {
+        return false;
+    }
+
+    std::array<int16_t, k_headerSizeInSamples> headerData;
+    const size_t idx = readPos & mask_;
+    const size_t firstSize = std::min( headerData.size(), size_ - idx );
+    std::copy( begin_ + idx, begin_ + idx + firstSize, headerData.begin() );
+    std::copy( begin_, begin_ + headerData.size() - firstSize, headerData.begin() + firstSize );
+    std::memcpy( &header, headerData.data(), sizeof( header ) );
+
+    return true;
+}
+
+void AudioBuffer::skip_chunk( uint64_t readPos, const AudioChunkHeader& header )
+{
+    readPos_.store( readPos + k_headerSizeInSamples + header.size, std::memory_order_release );
+}
+
+bool AudioBuffer::peek_current_chunk( uint64_t& readPos, AudioChunkHeader& header )
 {
-    return ( readPos_ != writePos_ );
+    // flush marker is always published before the counter is incremented,
+    // so all the markers we are waiting for are guaranteed to be reachable
+    const auto flushesWritten = flushesWritten_.load( std::memory_order_acquire );
+    const auto generation = generation_.load( std::memory_order_relaxed );
+
+    while ( peek_chunk( readPos, header ) )
+    {
+        if ( header.is_flush() )
+        {
+            ++flushesRead_;
+        }
+        else if ( flushesRead_ >= flushesWritten && header.generation == generation )
+        {
+            return true;
+        }
+        // only header is read, so skipping is cheap regardless of the chunk size
+        skip_chunk( readPos, header );
+    }
+
+    return false;
 }
 
 } // namespace sptf
@@ -4,6 +4,8 @@
 
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
 
 namespace sptf
@@ -11,79 +13,204 @@ namespace sptf
 
 class AbortManager;
 
-// TODO: bench and replace with lock-free if needed
+/// Lock-free single-producer/single-consumer ring buffer.
+/// Mutex is used only to park the consumer in `wait_for_data`.
 class AudioBuffer
 {
     static constexpr size_t k_maxBufferSize = 8UL * 1024 * 1024;
+    static_assert( !( k_maxBufferSize & ( k_maxBufferSize - 1 ) ), "Buffer size must be a power of 2" );
+    static constexpr size_t k_cacheLineSize = 64;
 
 public:
+    enum class SampleFormat : uint8_t
+    {
+        int16 = 0,
+    };
+
 #pragma pack( push )
 #pragma pack( 1 )
     struct AudioChunkHeader
     {
-        uint32_t sampleRate;
+        static constexpr uint8_t k_version = 3;
+
+        static constexpr uint8_t k_flagEof = 1 << 0;
+        static constexpr uint8_t k_flagFlush = 1 << 1;
+
+        uint8_t version;
+        SampleFormat format;
+        uint8_t flags;
+        uint8_t reserved;
         uint16_t channels;
+        uint32_t sampleRate;
+        /// in samples (i.e. frames * channels)
         uint32_t size;
-        uint16_t eof;
+        /// see `begin_seek`
+        uint32_t generation;
+
+        bool is_eof() const
+        {
+            return ( flags & k_flagEof );
+        }
+        bool is_flush() const
+        {
+            return ( flags & k_flagFlush );
+        }
     };
 #pragma pack( pop )
 
+    /// Distribution of published chunk durations
+    struct ChunkStats
+    {
+        static constexpr std::array<uint32_t, 7> k_bucketLimitsInMs = { 5, 10, 20, 50, 100, 200, 500 };
+        /// counts[i] - number of chunks with duration < k_bucketLimitsInMs[i],
+        /// last element - number of chunks with duration >= k_bucketLimitsInMs.back()
+        std::array<uint64_t, k_bucketLimitsInMs.size() + 1> counts{};
+    };
+
+    /// Distribution of delays between seek request and the first sample of the new position
+    struct SeekStats
+    {
+        static constexpr std::array<uint32_t, 7> k_bucketLimitsInMs = { 50, 100, 200, 500, 1000, 2000, 5000 };
+        /// same layout as `ChunkStats::counts`
+        std::array<uint64_t, k_bucketLimitsInMs.size() + 1> counts{};
+    };
+
 private:
-    static constexpr size_t k_headerSizeInU16 = sizeof( AudioChunkHeader ) / sizeof( uint16_t );
+    static constexpr size_t k_headerSizeInSamples = sizeof( AudioChunkHeader ) / sizeof( int16_t );
+    static_assert( sizeof( AudioChunkHeader ) % sizeof( int16_t ) == 0 );
 
 public:
     AudioBuffer( AbortManager& abortManager );
     ~AudioBuffer() = default;
 
-    bool write( AudioChunkHeader header, const uint16_t* data );
-    void write_end();
+    // producer (libspotify thread)
+
+    /// Consecutive writes with the same format are merged into a single chunk,
+    /// which is made visible to the consumer only when it reaches the target duration.
+    ///
+    /// @return number of frames written, might be less than `frameCount` if the buffer is full
+    size_t write( uint32_t sampleRate, uint16_t channels, const int16_t* data, size_t frameCount );
+    /// @return false if the buffer is full
+    bool write_end();
+    /// Discards everything that was written before this call
+    void write_flush();
+
+    // consumer (fb2k decoder thread)
 
+    /// Chunk data is passed as two spans, since it might be split by the end of the buffer.
+    /// Spans are valid only inside `fn`.
+    ///
+    /// @param fn void( const AudioChunkHeader& header, nonstd::span<const int16_t> first, nonstd::span<const int16_t> second )
     template <typename Fn>
     bool read( Fn fn );
 
-    bool has_data() const;
+    bool has_data();
     bool wait_for_data( abort_callback& abort );
 
-    void clear();
+    /// Starts a new generation: chunks that were written for the previous one are skipped on read.
+    /// Should be called before the track is loaded in libspotify.
+    void begin_track();
+    /// Same as `begin_track`, but also measures the seek latency.
+    /// Everything that is delivered before `end_seek` is dropped, since libspotify
+    /// might still be delivering the data from the previous position.
+    /// Should be called before the seek request is passed to libspotify.
+    void begin_seek();
+    /// Should be called after the seek request has been processed by libspotify.
+    void end_seek();
+
+    // any thread
+
+    ChunkStats get_chunk_stats() const;
+    SeekStats get_seek_stats() const;
+    void reset_stats();
 
 private:
-    bool has_data_no_lock() const;
+    void start_generation();
+    /// @return false if data should be dropped, since the seek is in progress
+    bool sync_generation();
+    AudioChunkHeader make_header( uint8_t flags, uint32_t sampleRate = 0, uint16_t channels = 0 ) const;
+    /// @return number of frames appended
+    size_t append( uint32_t sampleRate, uint16_t channels, const int16_t* data, size_t frameCount );
+    void publish_pending();
+    bool publish_marker( uint8_t flags, size_t reservedSize );
+    void write_header( uint64_t pos, const AudioChunkHeader& header );
+    void copy_to_buffer( uint64_t pos, const int16_t* data, size_t size );
+    void notify_consumer();
+    void update_chunk_stats( const AudioChunkHeader& header );
+    void update_seek_stats();
+
+    /// @return false if there are no chunks available
+    bool peek_chunk( uint64_t& readPos, AudioChunkHeader& header );
+    void skip_chunk( uint64_t readPos, const AudioChunkHeader& header );
+    /// Skips flushed and stale chunks
+    ///
+    /// @return false if there are no chunks of the current generation available
+    bool peek_current_chunk( uint64_t& readPos, AudioChunkHeader& header );
 
 private:
     AbortManager& abortManager_;
 
-    std::array<uint16_t, k_maxBufferSize> buffer_;
-    uint16_t* begin_ = buffer_.data();
+    std::array<int16_t, k_maxBufferSize> buffer_;
+    int16_t* begin_ = buffer_.data();
     static constexpr size_t size_ = k_maxBufferSize;
-
-    mutable std::mutex posMutex_;
+    static constexpr size_t mask_ = k_maxBufferSize - 1;
+
+    // positions are monotonic: index in buffer is `pos & mask_`
+
+    // written by consumer
+    alignas( k_cacheLineSize ) std::atomic<uint64_t> readPos_ = 0;
+    uint64_t flushesRead_ = 0;
+    std::chrono::steady_clock::time_point seekStartTime_;
+    bool isWaitingForSeekData_ = false;
+    std::atomic<uint32_t> generation_ = 0;
+    /// differs from `generation_` only while the seek is in progress
+    std::atomic<uint32_t> writableGeneration_ = 0;
+
+    // written by producer
+    alignas( k_cacheLineSize ) std::atomic<uint64_t> writePos_ = 0;
+    std::atomic<uint64_t> flushesWritten_ = 0;
+    bool isLastChunkFlush_ = false;
+    uint32_t writtenGeneration_ = 0;
+
+    // producer only: chunk that is being filled, it starts at `writePos_` and ends at `writeEnd_`
+    const uint32_t targetChunkDurationMs_;
+    uint64_t writeEnd_ = 0;
+    bool hasPendingChunk_ = false;
+    AudioChunkHeader pendingHeader_{};
+    size_t pendingTargetSize_ = 0;
+
+    alignas( k_cacheLineSize ) std::array<std::atomic<uint64_t>, ChunkStats::k_bucketLimitsInMs.size() + 1> chunkStats_{};
+    std::array<std::atomic<uint64_t>, SeekStats::k_bucketLimitsInMs.size() + 1> seekStats_{};
+
+    alignas( k_cacheLineSize ) std::atomic_bool isConsumerWaiting_ = false;
+    std::mutex waitMutex_;
     std::condition_variable dataCv_;
-
-    size_t readPos_ = 0;
-    size_t writePos_ = 0;
-    size_t waterMark_ = size_;
 };
 
 template <typename Fn>
 bool sptf::AudioBuffer::read( Fn fn )
 {
-    std::lock_guard lock( posMutex_ );
-
-    size_t readPos = readPos_;
-    const size_t writePos = writePos_;
-    const size_t waterMark = waterMark_;
-
-    if ( readPos == writePos )
+    uint64_t readPos;
+    AudioChunkHeader header;
+    if ( !peek_current_chunk( readPos, header ) )
     {
         return false;
     }
+    assert( header.version == AudioChunkHeader::k_version );
+    assert( header.format == SampleFormat::int16 );
 
-    readPos = ( readPos == waterMark ? 0 : readPos );
+    const size_t dataIdx = ( readPos + k_headerSizeInSamples ) & mask_;
+    const size_t firstSize = std::min<size_t>( header.size, size_ - dataIdx );
+    fn( header,
+        nonstd::span<const int16_t>( begin_ + dataIdx, firstSize ),
+        nonstd::span<const int16_t>( begin_, header.size - firstSize ) );
 
-    const auto curBufferPos = begin_ + readPos;
-    fn( *reinterpret_cast<AudioChunkHeader*>( curBufferPos ), curBufferPos + k_headerSizeInU16 );
+    skip_chunk( readPos, header );
 
-    readPos_ = readPos + k_headerSizeInU16 + reinterpret_cast<AudioChunkHeader*>( curBufferPos )->size;
+    if ( isWaitingForSeekData_ )
+    {
+        update_seek_stats();
+    }
 
     return true;
 }
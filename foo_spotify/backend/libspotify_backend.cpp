@@ -18,8 +18,12 @@
 #include <qwr/thread_helpers.h>
 #include <qwr/winapi_error_helpers.h>
 
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <thread>
 #include <tuple>
 
 // see https://github.com/mopidy/mopidy-spotify for tips and stuff
@@ -28,13 +32,69 @@ namespace fs = std::filesystem;
 
 using namespace sptf;
 
+namespace
+{
+
+/// All callers of `ExecSpMutex`: their lock wait counters are created beforehand,
+/// so that they can be found without locking
+constexpr std::string_view k_apiMutexCallers[] = {
+    "event loop",
+    "load registration",
+    "track error",
+    "session: create",
+    "session: release",
+    "login",
+    "logout",
+    "user name",
+    "settings: bitrate",
+    "settings: normalization",
+    "settings: private mode",
+    "settings: cache size",
+    "input: open",
+    "input: get length",
+    "input: player load",
+    "input: seek",
+    "input: release track",
+    "playback: pause",
+    "playback: stop",
+    "playback: prefetch lookup",
+    "playback: prefetch",
+    "playback: release prefetched track",
+    "other"
+};
+
+constexpr auto k_maxEventLoopYieldDuration = std::chrono::milliseconds( 10 );
+constexpr auto k_maxEventProcessingSliceDuration = std::chrono::milliseconds( 5 );
+
+uint64_t GetElapsedUs( std::chrono::steady_clock::time_point startTime )
+{
+    return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - startTime ).count() );
+}
+
+void UpdateMax( std::atomic<uint64_t>& maxValue, uint64_t value )
+{
+    auto curValue = maxValue.load( std::memory_order_relaxed );
+    while ( curValue < value && !maxValue.compare_exchange_weak( curValue, value, std::memory_order_relaxed ) )
+    {
+    }
+}
+
+} // namespace
+
 namespace sptf
 {
 
 LibSpotify_Backend::LibSpotify_Backend( AbortManager& abortManager )
     : abortManager_( abortManager )
+    , isAdaptiveEventLoop_( config::advanced::playback_adaptive_event_loop )
+    , loadDispatcher_( abortManager, [this]( const auto& fn ) { ExecSpMutex( "load registration", fn ); } )
     , audioBuffer_( abortManager )
 {
+    for ( const auto caller: k_apiMutexCallers )
+    {
+        lockWaitCounters_.try_emplace( std::string( caller ) );
+    }
+
     if ( const auto settingsPath = path::LibSpotifySettings(); !fs::exists( settingsPath ) )
     {
         fs::create_directories( settingsPath );
@@ -82,7 +142,7 @@ LibSpotify_Backend::LibSpotify_Backend( AbortManager& abortManager )
 
     SPTF_ASSIGN_CALLBACK( callbacks_, logged_in );
     SPTF_ASSIGN_DUMMY_CALLBACK( callbacks_, logged_out );
-    SPTF_ASSIGN_DUMMY_CALLBACK( callbacks_, metadata_updated );
+    SPTF_ASSIGN_CALLBACK( callbacks_, metadata_updated );
     SPTF_ASSIGN_DUMMY_CALLBACK( callbacks_, connection_error );
     SPTF_ASSIGN_CALLBACK( callbacks_, message_to_user );
     SPTF_ASSIGN_CALLBACK( callbacks_, notify_main_thread );
@@ -107,14 +167,13 @@ LibSpotify_Backend::LibSpotify_Backend( AbortManager& abortManager )
 
     // TODO: check if `sp_playlist_add_callbacks` works when implementing playlist handling
 
-    {
-        std::lock_guard lock( apiMutex_ );
+    ExecSpMutex( "session: create", [&] {
         const auto sp = sp_session_create( &config_, &pSpSession_ );
         if ( sp != SP_ERROR_OK )
         {
             throw qwr::QwrException( fmt::format( "sp_session_create failed: {}", sp_error_message( sp ) ) );
         }
-    }
+    } );
 
     StartEventLoopThread();
 
@@ -136,11 +195,10 @@ void LibSpotify_Backend::Finalize()
         }
     }
 
-    {
-        std::lock_guard lock( apiMutex_ );
+    ExecSpMutex( "session: release", [&] {
         sp_session_player_unload( pSpSession_ );
         sp_session_release( pSpSession_ );
-    }
+    } );
 }
 
 void LibSpotify_Backend::RegisterBackendUser( LibSpotify_BackendUser& input )
@@ -180,6 +238,51 @@ sp_session* LibSpotify_Backend::GetWhateverSpSession()
     return pSpSession_;
 }
 
+sp_error LibSpotify_Backend::WaitForTrackLoad( sp_track* track, abort_callback& abort )
+{
+    assert( track );
+
+    WaitForTracksLoad( nonstd::span<sp_track* const>( &track, 1 ), abort );
+    return ExecSpMutex( "track error", [&] {
+        return sp_track_error( track );
+    } );
+}
+
+void LibSpotify_Backend::WaitForTracksLoad( nonstd::span<sp_track* const> tracks, abort_callback& abort )
+{
+    std::vector<void*> objects( tracks.begin(), tracks.end() );
+    loadDispatcher_.WaitForLoad(
+        objects, []( void* pObject ) {
+            // track might fail to load, in which case `sp_track_is_loaded` is never true
+            return ( sp_track_error( static_cast<sp_track*>( pObject ) ) != SP_ERROR_IS_LOADING );
+        },
+        abort );
+}
+
+void LibSpotify_Backend::WaitForAlbumLoad( sp_album* album, abort_callback& abort )
+{
+    assert( album );
+
+    void* object = album;
+    loadDispatcher_.WaitForLoad(
+        nonstd::span<void* const>( &object, 1 ), []( void* pObject ) -> bool {
+            return sp_album_is_loaded( static_cast<sp_album*>( pObject ) );
+        },
+        abort );
+}
+
+void LibSpotify_Backend::WaitForArtistLoad( sp_artist* artist, abort_callback& abort )
+{
+    assert( artist );
+
+    void* object = artist;
+    loadDispatcher_.WaitForLoad(
+        nonstd::span<void* const>( &object, 1 ), []( void* pObject ) -> bool {
+            return sp_artist_is_loaded( static_cast<sp_artist*>( pObject ) );
+        },
+        abort );
+}
+
 bool LibSpotify_Backend::Relogin( abort_callback& abort )
 {
     {
@@ -194,10 +297,9 @@ bool LibSpotify_Backend::Relogin( abort_callback& abort )
         {
             loginStatus_ = LoginStatus::login_in_process;
 
-            const auto spRet = [&] {
-                std::lock_guard lock( apiMutex_ );
+            const auto spRet = ExecSpMutex( "login", [&] {
                 return sp_session_relogin( pSpSession_ );
-            }();
+            } );
             if ( spRet == SP_ERROR_NO_CREDENTIALS )
             {
                 loginStatus_ = LoginStatus::logged_out;
@@ -241,10 +343,9 @@ bool LibSpotify_Backend::LoginWithUI( HWND hWnd )
             return false;
         }
 
-        {
-            std::lock_guard lock( apiMutex_ );
+        ExecSpMutex( "login", [&] {
             sp_session_login( pSpSession_, cpr->un.data(), cpr->pw.data(), true, nullptr );
-        }
+        } );
 
         qwr::TimedAbortCallback tac( fmt::format( "{}: {}", SPTF_UNDERSCORE_NAME, "LibSpotify wait for login update" ) );
         retStatus = WaitForLoginStatusUpdate( tac );
@@ -265,11 +366,10 @@ void LibSpotify_Backend::LogoutAndForget( abort_callback& abort )
         loginStatus_ = LoginStatus::logout_in_process;
     }
 
-    {
-        std::lock_guard lgApi( apiMutex_ );
+    ExecSpMutex( "logout", [&] {
         sp_session_logout( pSpSession_ );
         sp_session_forget_me( pSpSession_ );
-    }
+    } );
 
     WaitForLoginStatusUpdate( abort );
 }
@@ -284,38 +384,40 @@ std::string LibSpotify_Backend::GetLoggedInUserName()
         }
     }
 
-    std::lock_guard lock( apiMutex_ );
+    return ExecSpMutex( "user name", [&]() -> std::string {
+        // `sp_user_display_name` always returns canonical name:
+        // https://stackoverflow.com/questions/23797162/sp-user-display-name-always-returns-canonical-name-even-when-user-is-loaded
 
-    // `sp_user_display_name` always returns canonical name:
-    // https://stackoverflow.com/questions/23797162/sp-user-display-name-always-returns-canonical-name-even-when-user-is-loaded
-
-    const char* email = sp_session_user_name( pSpSession_ );
-    if ( !email )
-    {
-        return "<error: user name could not be fetched>";
-    }
+        const char* email = sp_session_user_name( pSpSession_ );
+        if ( !email )
+        {
+            return "<error: user name could not be fetched>";
+        }
 
-    return email;
+        return email;
+    } );
 }
 
 void LibSpotify_Backend::RefreshBitrate()
 {
-    std::lock_guard lock( apiMutex_ );
-    const auto sp = sp_session_preferred_bitrate( pSpSession_, static_cast<sp_bitrate>( static_cast<uint8_t>( config::preferred_bitrate.GetValue() ) ) );
-    if ( sp != SP_ERROR_OK )
-    {
-        qwr::ReportErrorWithPopup( SPTF_UNDERSCORE_NAME, fmt::format( "sp_session_preferred_bitrate failed:\n{}", sp_error_message( sp ) ) );
-    }
+    ExecSpMutex( "settings: bitrate", [&] {
+        const auto sp = sp_session_preferred_bitrate( pSpSession_, static_cast<sp_bitrate>( static_cast<uint8_t>( config::preferred_bitrate.GetValue() ) ) );
+        if ( sp != SP_ERROR_OK )
+        {
+            qwr::ReportErrorWithPopup( SPTF_UNDERSCORE_NAME, fmt::format( "sp_session_preferred_bitrate failed:\n{}", sp_error_message( sp ) ) );
+        }
+    } );
 }
 
 void LibSpotify_Backend::RefreshNormalization()
 {
-    std::lock_guard lock( apiMutex_ );
-    const auto sp = sp_session_set_volume_normalization( pSpSession_, config::enable_normalization );
-    if ( sp != SP_ERROR_OK )
-    {
-        qwr::ReportErrorWithPopup( SPTF_UNDERSCORE_NAME, fmt::format( "sp_session_set_volume_normalization failed:\n{}", sp_error_message( sp ) ) );
-    }
+    ExecSpMutex( "settings: normalization", [&] {
+        const auto sp = sp_session_set_volume_normalization( pSpSession_, config::enable_normalization );
+        if ( sp != SP_ERROR_OK )
+        {
+            qwr::ReportErrorWithPopup( SPTF_UNDERSCORE_NAME, fmt::format( "sp_session_set_volume_normalization failed:\n{}", sp_error_message( sp ) ) );
+        }
+    } );
 }
 
 void LibSpotify_Backend::RefreshPrivateMode()
@@ -328,10 +430,9 @@ void LibSpotify_Backend::RefreshPrivateMode()
         }
     }
 
-    {
-        std::lock_guard lock( apiMutex_ );
+    ExecSpMutex( "settings: private mode", [&] {
         RefreshPrivateModeNonBlocking();
-    }
+    } );
 }
 
 void LibSpotify_Backend::RefreshCacheSize()
@@ -373,16 +474,79 @@ void LibSpotify_Backend::RefreshCacheSize()
         }
     }();
 
-    std::lock_guard lock( apiMutex_ );
-    const auto sp = sp_session_set_cache_size( pSpSession_, cacheSize );
-    if ( sp != SP_ERROR_OK )
+    ExecSpMutex( "settings: cache size", [&] {
+        const auto sp = sp_session_set_cache_size( pSpSession_, cacheSize );
+        if ( sp != SP_ERROR_OK )
+        {
+            qwr::ReportErrorWithPopup( SPTF_UNDERSCORE_NAME, fmt::format( "sp_session_set_cache_size failed:\n{}", sp_error_message( sp ) ) );
+        }
+    } );
+}
+
+LibSpotify_Backend::EventLoopStats LibSpotify_Backend::GetEventLoopStats() const
+{
+    EventLoopStats stats;
+    stats.notifyWakeups = notifyWakeups_.load( std::memory_order_relaxed );
+    stats.timeoutWakeups = timeoutWakeups_.load( std::memory_order_relaxed );
+    stats.yields = yields_.load( std::memory_order_relaxed );
+    stats.processEventsCount = processEventsCount_.load( std::memory_order_relaxed );
+    stats.processEventsTotalUs = processEventsTotalUs_.load( std::memory_order_relaxed );
+    stats.processEventsMaxUs = processEventsMaxUs_.load( std::memory_order_relaxed );
+
+    for ( const auto& [caller, counters]: lockWaitCounters_ )
+    {
+        const auto count = counters.count.load( std::memory_order_relaxed );
+        if ( !count )
+        {
+            continue;
+        }
+
+        stats.lockWaits.push_back( { caller,
+                                     count,
+                                     counters.totalWaitUs.load( std::memory_order_relaxed ),
+                                     counters.maxWaitUs.load( std::memory_order_relaxed ) } );
+    }
+
+    return stats;
+}
+
+LibSpotify_Backend::LockWaitCounters& LibSpotify_Backend::GetLockWaitCounters( std::string_view caller )
+{
+    if ( auto it = lockWaitCounters_.find( caller ); it != lockWaitCounters_.end() )
     {
-        qwr::ReportErrorWithPopup( SPTF_UNDERSCORE_NAME, fmt::format( "sp_session_set_cache_size failed:\n{}", sp_error_message( sp ) ) );
+        return it->second;
     }
+
+    assert( false && "caller is missing from `k_apiMutexCallers`" );
+    return lockWaitCounters_.find( "other" )->second;
+}
+
+std::unique_lock<std::mutex> LibSpotify_Backend::LockApiMutex( LockWaitCounters& lockWaitCounters )
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    apiMutexWaiters_.fetch_add( 1, std::memory_order_relaxed );
+    std::unique_lock lock( apiMutex_ );
+    if ( apiMutexWaiters_.fetch_sub( 1, std::memory_order_relaxed ) == 1 )
+    {
+        {
+            std::lock_guard cvLock( apiMutexWaitersCvMutex_ );
+        }
+        apiMutexWaitersCv_.notify_all();
+    }
+
+    const auto waitUs = GetElapsedUs( startTime );
+    lockWaitCounters.count.fetch_add( 1, std::memory_order_relaxed );
+    lockWaitCounters.totalWaitUs.fetch_add( waitUs, std::memory_order_relaxed );
+    UpdateMax( lockWaitCounters.maxWaitUs, waitUs );
+
+    return lock;
 }
 
 void LibSpotify_Backend::EventLoopThread()
 {
+    auto& lockWaitCounters = GetLockWaitCounters( "event loop" );
+
     int nextTimeout = INFINITE;
     while ( true )
     {
@@ -402,11 +566,61 @@ void LibSpotify_Backend::EventLoopThread()
             {
                 return;
             }
+
+            ( hasEvents_ ? notifyWakeups_ : timeoutWakeups_ ).fetch_add( 1, std::memory_order_relaxed );
             hasEvents_ = false;
         }
 
-        std::lock_guard lock( apiMutex_ );
+        if ( isAdaptiveEventLoop_ )
+        {
+            YieldToApiCallers();
+        }
+
+        const auto lock = LockApiMutex( lockWaitCounters );
+        nextTimeout = ProcessEventsSlice();
+    }
+}
+
+void LibSpotify_Backend::YieldToApiCallers()
+{
+    if ( !apiMutexWaiters_.load( std::memory_order_relaxed ) )
+    {
+        return;
+    }
+
+    yields_.fetch_add( 1, std::memory_order_relaxed );
+
+    // bounded, so that a stream of API calls can't stall event processing
+    std::unique_lock lock( apiMutexWaitersCvMutex_ );
+    apiMutexWaitersCv_.wait_for( lock, k_maxEventLoopYieldDuration, [&] {
+        return !apiMutexWaiters_.load( std::memory_order_relaxed );
+    } );
+}
+
+int LibSpotify_Backend::ProcessEventsSlice()
+{
+    const auto sliceStartTime = std::chrono::steady_clock::now();
+
+    int nextTimeout = 0;
+    while ( true )
+    {
+        const auto startTime = std::chrono::steady_clock::now();
         sp_session_process_events( pSpSession_, &nextTimeout );
+        const auto durationUs = GetElapsedUs( startTime );
+
+        processEventsCount_.fetch_add( 1, std::memory_order_relaxed );
+        processEventsTotalUs_.fetch_add( durationUs, std::memory_order_relaxed );
+        UpdateMax( processEventsMaxUs_, durationUs );
+
+        // when there are more events to process, `nextTimeout` is 0:
+        // the rest is processed in the next slice, so that API callers can be served in-between
+        if ( nextTimeout
+             || !isAdaptiveEventLoop_
+             || apiMutexWaiters_.load( std::memory_order_relaxed )
+             || std::chrono::steady_clock::now() - sliceStartTime >= k_maxEventProcessingSliceDuration )
+        {
+            return nextTimeout;
+        }
     }
 }
 
@@ -521,6 +735,12 @@ void LibSpotify_Backend::logged_in( sp_error error )
     }
 }
 
+void LibSpotify_Backend::metadata_updated()
+{
+    // called from `sp_session_process_events`, i.e. under `apiMutex_`
+    loadDispatcher_.ProcessPendingLoads();
+}
+
 void LibSpotify_Backend::message_to_user( const char* message )
 {
     qwr::ReportErrorWithPopup( SPTF_NAME, message );
@@ -540,24 +760,25 @@ int LibSpotify_Backend::music_delivery( const sp_audioformat* format, const void
 {
     if ( !num_frames )
     {
-        audioBuffer_.clear();
+        audioBuffer_.write_flush();
         return 0;
     }
 
-    if ( !audioBuffer_.write( AudioBuffer::AudioChunkHeader{ (uint16_t)format->sample_rate,
-                                                             (uint16_t)format->channels,
-                                                             ( uint16_t )( num_frames * format->channels ) },
-                              static_cast<const uint16_t*>( frames ) ) )
-    {
-        return 0;
-    }
+    // libspotify only supports native-endian int16 samples
+    assert( format->sample_type == SP_SAMPLETYPE_INT16_NATIVE_ENDIAN );
+    assert( format->sample_rate > 0 && format->channels > 0 && format->channels <= std::numeric_limits<uint16_t>::max() );
 
-    return num_frames;
+    // might consume only a part of the frames: libspotify will redeliver the rest
+    return static_cast<int>( audioBuffer_.write( static_cast<uint32_t>( format->sample_rate ),
+                                                 static_cast<uint16_t>( format->channels ),
+                                                 static_cast<const int16_t*>( frames ),
+                                                 static_cast<size_t>( num_frames ) ) );
 }
 
 void LibSpotify_Backend::end_of_track()
 {
-    audioBuffer_.write_end();
+    [[maybe_unused]] const auto bRet = audioBuffer_.write_end();
+    assert( bRet );
 }
 
 void LibSpotify_Backend::play_token_lost()
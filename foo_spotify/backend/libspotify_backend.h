@@ -2,13 +2,21 @@
 
 #include <backend/audio_buffer.h>
 #include <backend/libspotify_backend_user.h>
+#include <backend/libspotify_load_dispatcher.h>
 #include <fb2k/config.h>
 
 #include <libspotify/api.h>
+#include <nonstd/span.hpp>
 
+#include <atomic>
 #include <condition_variable>
+#include <map>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <unordered_set>
+#include <vector>
 
 namespace sptf
 {
@@ -17,6 +25,36 @@ class AbortManager;
 
 class LibSpotify_Backend
 {
+public:
+    struct EventLoopStats
+    {
+        struct LockWaitStats
+        {
+            std::string caller;
+            uint64_t count;
+            uint64_t totalWaitUs;
+            uint64_t maxWaitUs;
+        };
+
+        uint64_t notifyWakeups = 0;
+        uint64_t timeoutWakeups = 0;
+        /// number of times the event loop let waiting API callers go first
+        uint64_t yields = 0;
+        uint64_t processEventsCount = 0;
+        uint64_t processEventsTotalUs = 0;
+        uint64_t processEventsMaxUs = 0;
+        /// `apiMutex_` wait times per caller
+        std::vector<LockWaitStats> lockWaits;
+    };
+
+private:
+    struct LockWaitCounters
+    {
+        std::atomic<uint64_t> count = 0;
+        std::atomic<uint64_t> totalWaitUs = 0;
+        std::atomic<uint64_t> maxWaitUs = 0;
+    };
+
 public:
     LibSpotify_Backend( AbortManager& abortManager );
     LibSpotify_Backend( const LibSpotify_Backend& ) = delete;
@@ -36,13 +74,29 @@ public:
     sp_session* GetInitializedSpSession( abort_callback& abort );
     sp_session* GetWhateverSpSession();
 
+    // Wait methods block until object metadata is loaded (or failed to load).
+    // They must not be called while holding the libspotify mutex.
+
+    /// @return result of `sp_track_error`, never SP_ERROR_IS_LOADING
+    /// @throw exception_aborted
+    sp_error WaitForTrackLoad( sp_track* track, abort_callback& abort );
+    /// @throw exception_aborted
+    void WaitForTracksLoad( nonstd::span<sp_track* const> tracks, abort_callback& abort );
+    /// @throw exception_aborted
+    void WaitForAlbumLoad( sp_album* album, abort_callback& abort );
+    /// @throw exception_aborted
+    void WaitForArtistLoad( sp_artist* artist, abort_callback& abort );
+
+    /// @param caller name of the call site, used in lock wait stats
     template <typename Fn, typename... Args>
-    auto ExecSpMutex( Fn func, Args&&... args ) -> decltype( auto )
+    auto ExecSpMutex( std::string_view caller, Fn func, Args&&... args ) -> decltype( auto )
     {
-        std::lock_guard lock( apiMutex_ );
+        const auto lock = LockApiMutex( GetLockWaitCounters( caller ) );
         return func( std::forward<Args>( args )... );
     }
 
+    EventLoopStats GetEventLoopStats() const;
+
     bool Relogin( abort_callback& abort );
     bool LoginWithUI( HWND hWnd );
     void LogoutAndForget( abort_callback& abort );
@@ -55,7 +109,18 @@ public:
     void RefreshCacheSize();
 
 private:
+    LockWaitCounters& GetLockWaitCounters( std::string_view caller );
+    std::unique_lock<std::mutex> LockApiMutex( LockWaitCounters& lockWaitCounters );
+
     void EventLoopThread();
+    /// std::mutex is not fair: without this API callers might be blocked
+    /// for several event processing slices in a row.
+    void YieldToApiCallers();
+    /// Processes events until there are none left, the slice time is up or API callers are waiting.
+    /// Should be called under the libspotify mutex.
+    ///
+    /// @return timeout until the next event processing
+    int ProcessEventsSlice();
     void StartEventLoopThread();
     void StopEventLoopThread();
 
@@ -67,6 +132,7 @@ private:
 
     void log_message( const char* error );
     void logged_in( sp_error error );
+    void metadata_updated();
     void message_to_user( const char* error );
     void notify_main_thread();
     int music_delivery( const sp_audioformat* format, const void* frames, int num_frames );
@@ -86,12 +152,30 @@ private:
 
     std::mutex apiMutex_;
     sp_session* pSpSession_ = nullptr;
+    std::atomic<uint32_t> apiMutexWaiters_ = 0;
+    /// signaled when there are no `apiMutex_` waiters left
+    std::condition_variable apiMutexWaitersCv_;
+    std::mutex apiMutexWaitersCvMutex_;
+
+    /// created on construction and not modified afterwards, so it can be accessed without lock;
+    /// std::less<> allows lookup by std::string_view
+    std::map<std::string, LockWaitCounters, std::less<>> lockWaitCounters_;
 
     std::unique_ptr<std::thread> pWorker_;
     std::mutex workerMutex_;
     std::condition_variable eventLoopCv_;
     bool hasEvents_ = false;
     bool shouldStopEventLoop_ = false;
+    const bool isAdaptiveEventLoop_;
+
+    std::atomic<uint64_t> notifyWakeups_ = 0;
+    std::atomic<uint64_t> timeoutWakeups_ = 0;
+    std::atomic<uint64_t> yields_ = 0;
+    std::atomic<uint64_t> processEventsCount_ = 0;
+    std::atomic<uint64_t> processEventsTotalUs_ = 0;
+    std::atomic<uint64_t> processEventsMaxUs_ = 0;
+
+    LibSpotify_LoadDispatcher loadDispatcher_;
 
     std::mutex backendUsersMutex_;
     std::unordered_set<LibSpotify_BackendUser*> backendUsers_;
@@ -0,0 +1,105 @@
+#include <stdafx.h>
+
+#include "libspotify_load_dispatcher.h"
+
+#include <utils/abort_manager.h>
+
+#include <algorithm>
+
+namespace sptf
+{
+
+LibSpotify_LoadDispatcher::LibSpotify_LoadDispatcher( AbortManager& abortManager, ApiMutexExecutor execUnderApiMutex )
+    : abortManager_( abortManager )
+    , execUnderApiMutex_( std::move( execUnderApiMutex ) )
+{
+}
+
+void LibSpotify_LoadDispatcher::WaitForLoad( nonstd::span<void* const> objects, IsLoadedFn isLoaded, abort_callback& abort )
+{
+    LoadWaiter waiter;
+
+    // registration is done under the libspotify mutex, so that no update can be missed
+    execUnderApiMutex_( [&] {
+        std::lock_guard lock( mutex_ );
+        for ( auto pObject: objects )
+        {
+            if ( isLoaded( pObject ) )
+            {
+                continue;
+            }
+
+            auto& pendingLoad = pendingLoads_.try_emplace( pObject, PendingLoad{ isLoaded } ).first->second;
+            pendingLoad.waiters.emplace_back( &waiter );
+            ++waiter.pendingCount;
+        }
+    } );
+
+    if ( !waiter.pendingCount )
+    {
+        return;
+    }
+
+    {
+        const auto abortableScope = abortManager_.GetAbortableScope( [&] {
+            {
+                std::lock_guard lock( mutex_ );
+            }
+            waiter.cv.notify_all();
+        },
+                                                                     abort );
+
+        std::unique_lock lock( mutex_ );
+        waiter.cv.wait( lock, [&] {
+            return ( !waiter.pendingCount || abort.is_aborting() );
+        } );
+
+        if ( waiter.pendingCount )
+        { // aborted: waiter must not be accessed after return
+            for ( auto pObject: objects )
+            {
+                auto it = pendingLoads_.find( pObject );
+                if ( it == pendingLoads_.end() )
+                {
+                    continue;
+                }
+
+                auto& waiters = it->second.waiters;
+                waiters.erase( std::remove( waiters.begin(), waiters.end(), &waiter ), waiters.end() );
+                if ( waiters.empty() )
+                {
+                    pendingLoads_.erase( it );
+                }
+            }
+        }
+    }
+
+    abort.check();
+}
+
+void LibSpotify_LoadDispatcher::ProcessPendingLoads()
+{
+    std::lock_guard lock( mutex_ );
+
+    for ( auto it = pendingLoads_.begin(); it != pendingLoads_.end(); )
+    {
+        auto& [pObject, pendingLoad] = *it;
+        if ( !pendingLoad.isLoaded( pObject ) )
+        {
+            ++it;
+            continue;
+        }
+
+        // only those who are waiting for this object (and nothing else) are woken up
+        for ( auto pWaiter: pendingLoad.waiters )
+        {
+            if ( !--pWaiter->pendingCount )
+            {
+                pWaiter->cv.notify_all();
+            }
+        }
+        it = pendingLoads_.erase( it );
+    }
+}
+
+} // namespace sptf
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <nonstd/span.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace sptf
+{
+
+class AbortManager;
+
+/// Wakes up load waiters when libspotify reports that their objects are loaded.
+/// Objects are re-checked only on `ProcessPendingLoads` (i.e. on `metadata_updated` callback),
+/// and only those who are waiting for the loaded objects are woken up.
+class LibSpotify_LoadDispatcher
+{
+public:
+    /// Should be called under the libspotify mutex
+    using IsLoadedFn = bool ( * )( void* );
+    /// Executes the function under the libspotify mutex
+    using ApiMutexExecutor = std::function<void( const std::function<void()>& )>;
+
+    LibSpotify_LoadDispatcher( AbortManager& abortManager, ApiMutexExecutor execUnderApiMutex );
+    LibSpotify_LoadDispatcher( const LibSpotify_LoadDispatcher& ) = delete;
+    LibSpotify_LoadDispatcher( LibSpotify_LoadDispatcher&& ) = delete;
+    ~LibSpotify_LoadDispatcher() = default;
+
+    /// Blocks until all the objects are loaded.
+    /// Must not be called while holding the libspotify mutex.
+    ///
+    /// @throw exception_aborted
+    void WaitForLoad( nonstd::span<void* const> objects, IsLoadedFn isLoaded, abort_callback& abort );
+
+    /// Should be called under the libspotify mutex
+    void ProcessPendingLoads();
+
+private:
+    struct LoadWaiter
+    {
+        size_t pendingCount = 0;
+        std::condition_variable cv;
+    };
+    struct PendingLoad
+    {
+        IsLoadedFn isLoaded;
+        std::vector<LoadWaiter*> waiters;
+    };
+
+private:
+    AbortManager& abortManager_;
+    const ApiMutexExecutor execUnderApiMutex_;
+
+    // lock order: libspotify mutex -> `mutex_`
+    std::mutex mutex_;
+    std::unordered_map<void*, PendingLoad> pendingLoads_;
+};
+
+} // namespace sptf
@@ -105,7 +105,7 @@ void SpotifyInstance::InitializeAll()
     }
     if ( !fb2k_playCallbacks_initialized_ )
     {
-        fb2k::PlayCallbacks::Initialize( *pLibSpotify_backend_ );
+        fb2k::PlayCallbacks::Initialize( *pLibSpotify_backend_, *pThreadPool_ );
         fb2k_playCallbacks_initialized_ = true;
     }
 }
@@ -3,13 +3,13 @@
 #include "webapi_backend.h"
 
 #include <backend/webapi_auth.h>
+#include <backend/webapi_json_filter.h>
 #include <backend/webapi_objects/webapi_media_objects.h>
 #include <backend/webapi_objects/webapi_paging_object.h>
 #include <backend/webapi_objects/webapi_user.h>
 #include <fb2k/advanced_config.h>
 #include <utils/abort_manager.h>
 #include <utils/json_std_extenders.h>
-#include <utils/sleeper.h>
 
 #include <component_urls.h>
 
@@ -20,8 +20,11 @@
 #include <qwr/type_traits.h>
 #include <qwr/winapi_error_helpers.h>
 
+#include <array>
+#include <atomic>
+#include <deque>
 #include <filesystem>
-#include <unordered_set>
+#include <tuple>
 
 // TODO: replace unique_ptr with shared_ptr wherever needed to avoid copying
 
@@ -31,9 +34,128 @@ namespace
 {
 
 constexpr size_t kRpsLimit = 2;
+constexpr size_t kMaxRpsLimit = 10;
+constexpr size_t kRpsBurstLimit = 4;
+constexpr size_t kMaxConcurrentPageRequests = 4;
+constexpr size_t kMaxConcurrentBatchRequests = 4;
+constexpr size_t kMaxItemsPerBatchRequest = 50;
+constexpr size_t kMaxPlaylistItemsPerRequest = 100;
+constexpr size_t kMaxRequestAttempts = 3;
+
+const std::string& GetPlaylistPageFieldsFilter()
+{
+    static const auto fieldsFilter = GetFieldsFilter( static_cast<const sptf::WebApi_PagingObject*>( nullptr ),
+                                                      GetFieldsFilter( static_cast<const sptf::WebApi_PlaylistTrack*>( nullptr ) ) );
+    return fieldsFilter;
+}
+
+web::uri GetPlaylistTracksUri( const std::string& playlistId )
+{
+    // only the fields that are deserialized are requested:
+    // this skips huge fields like `available_markets`
+    static const auto fieldsFilter = qwr::unicode::ToWide( GetPlaylistPageFieldsFilter() );
+
+    web::uri_builder builder;
+    builder
+        .append_path( fmt::format( L"playlists/{}/tracks", qwr::unicode::ToWide( playlistId ) ) )
+        .append_query( L"fields", fieldsFilter );
+
+    return builder.to_uri();
+}
 
+// Most of the endpoints don't support `fields` parameter,
+// so the unused fields are skipped on our side instead.
+
+const sptf::WebApi_JsonFilter& GetPlaylistPageJsonFilter()
+{
+    static const sptf::WebApi_JsonFilter filter( GetPlaylistPageFieldsFilter() );
+    return filter;
+}
+
+const sptf::WebApi_JsonFilter& GetTrackJsonFilter()
+{
+    static const sptf::WebApi_JsonFilter filter( GetFieldsFilter( static_cast<const sptf::WebApi_Track*>( nullptr ) ) );
+    return filter;
 }
 
+const sptf::WebApi_JsonFilter& GetTracksJsonFilter()
+{
+    static const sptf::WebApi_JsonFilter filter( fmt::format( "tracks({})", GetFieldsFilter( static_cast<const sptf::WebApi_Track*>( nullptr ) ) ) );
+    return filter;
+}
+
+/// Blocks until the task is complete
+///
+/// @param startTask pplx::task<T>( pplx::cancellation_token token ), token is canceled on abort
+/// @throw qwr::QwrException on abort
+template <typename Fn>
+auto WaitForTask( sptf::AbortManager& abortManager, abort_callback& abort, Fn startTask )
+{
+    pplx::cancellation_token_source localCts;
+    const auto abortableScope = abortManager.GetAbortableScope( [&localCts] { localCts.cancel(); }, abort );
+
+    try
+    {
+        return startTask( localCts.get_token() ).get();
+    }
+    catch ( const pplx::task_canceled& )
+    {
+        throw qwr::QwrException( "Abort was signaled, canceling request..." );
+    }
+}
+
+struct ChunkProcessingState
+{
+    std::vector<std::string> ids;
+    size_t chunkSize;
+    std::function<pplx::task<void>( nonstd::span<const std::string> )> processChunk;
+    std::atomic<size_t> nextOffset = 0;
+};
+
+/// Processes chunks one by one until there are none left
+pplx::task<void> ProcessChunksSequentiallyAsync( std::shared_ptr<ChunkProcessingState> pState )
+{
+    const auto offset = pState->nextOffset.fetch_add( pState->chunkSize );
+    if ( offset >= pState->ids.size() )
+    {
+        return pplx::task_from_result();
+    }
+
+    const auto chunkSize = std::min( pState->chunkSize, pState->ids.size() - offset );
+    return pState->processChunk( nonstd::span<const std::string>( pState->ids.data() + offset, chunkSize ) )
+        .then( [pState] { return ProcessChunksSequentiallyAsync( pState ); } );
+}
+
+/// Splits ids into chunks and processes them,
+/// with no more than `maxChunksInFlight` chunks being processed at the same time.
+///
+/// Unlike starting all the requests at once, this doesn't occupy a thread per chunk
+/// while the requests are waiting in the rate limiter.
+pplx::task<void> ProcessChunksAsync( std::vector<std::string> ids,
+                                     size_t chunkSize,
+                                     size_t maxChunksInFlight,
+                                     std::function<pplx::task<void>( nonstd::span<const std::string> )> processChunk )
+{
+    assert( chunkSize );
+
+    const auto pState = std::make_shared<ChunkProcessingState>();
+    pState->ids = std::move( ids );
+    pState->chunkSize = chunkSize;
+    pState->processChunk = std::move( processChunk );
+
+    const auto chunkCount = ( pState->ids.size() + chunkSize - 1 ) / chunkSize;
+
+    std::vector<pplx::task<void>> tasks;
+    for ( size_t i = 0; i < std::min( chunkCount, maxChunksInFlight ); ++i )
+    {
+        tasks.emplace_back( ProcessChunksSequentiallyAsync( pState ) );
+    }
+
+    return pplx::when_all( tasks.begin(), tasks.end() );
+}
+
+} // namespace
+
 namespace sptf
 {
 
@@ -41,10 +163,21 @@ WebApi_Backend::WebApi_Backend( AbortManager& abortManager )
     : abortManager_( abortManager )
     , shouldLogWebApiRequest_( config::advanced::logging_webapi_request )
     , shouldLogWebApiResponse_( config::advanced::logging_webapi_response )
-    , rpsLimiter_( kRpsLimit )
+    , isKeepAliveEnabled_( config::advanced::network_keep_alive )
+    , rpsLimiter_( abortManager, kRpsLimit, kMaxRpsLimit, kRpsBurstLimit, config::advanced::logging_webapi_debug )
     , client_( url::spotifyApi, GetClientConfig() )
-    , trackCache_( "tracks" )
-    , artistCache_( "artists" )
+    , trackCache_( "tracks", static_cast<size_t>( config::advanced::cache_memory_limit.GetValue() ) * 1024 * 1024 )
+    , artistCache_( "artists", static_cast<size_t>( config::advanced::cache_memory_limit.GetValue() ) * 1024 * 1024 )
+    , trackBatcher_(
+          abortManager,
+          [&]( auto ids, auto token ) { return RefreshCacheForTracksAsync( ids, RequestPriority::interactive, token ); },
+          kMaxItemsPerBatchRequest,
+          std::chrono::milliseconds( config::advanced::network_batch_window.GetValue() ) )
+    , artistBatcher_(
+          abortManager,
+          [&]( auto ids, auto token ) { return RefreshCacheForArtistsAsync( ids, RequestPriority::interactive, token ); },
+          kMaxItemsPerBatchRequest,
+          std::chrono::milliseconds( config::advanced::network_batch_window.GetValue() ) )
     , albumImageCache_( "albums" )
     , artistImageCache_( "artists" )
     , pAuth_( std::make_unique<WebApiAuthorizer>( GetClientConfig(), abortManager ) )
@@ -58,6 +191,39 @@ WebApi_Backend::~WebApi_Backend()
 void WebApi_Backend::Finalize()
 {
     cts_.cancel();
+
+    trackBatcher_.Finalize();
+    artistBatcher_.Finalize();
+
+    std::vector<std::shared_ptr<SharedRequest>> requests;
+    {
+        std::lock_guard lock( sharedRequestsMutex_ );
+        for ( auto& [_, pRequest]: sharedRequests_ )
+        {
+            requests.emplace_back( pRequest );
+        }
+    }
+    // cancellation might trigger continuations, which should not be executed under lock
+    for ( auto& pRequest: requests )
+    {
+        pRequest->abort.abort();
+        pRequest->cts.cancel();
+    }
+    for ( auto& pRequest: requests )
+    {
+        pRequest->task.wait();
+    }
+
+    // there are no more requests that could add new objects
+    trackCache_.Flush();
+    artistCache_.Flush();
+
+    if ( config::advanced::logging_webapi_debug )
+    {
+        LogCacheStats( "tracks", trackCache_ );
+        LogCacheStats( "artists", artistCache_ );
+    }
+
     pAuth_.reset();
 }
 
@@ -78,7 +244,7 @@ std::unique_ptr<const sptf::WebApi_User> WebApi_Backend::GetUser( abort_callback
         web::uri_builder builder;
         builder.append_path( L"me" );
 
-        const auto responseJson = GetJsonResponse( builder.to_uri(), abort );
+        const auto responseJson = GetJsonResponse( builder.to_uri(), RequestPriority::interactive, abort );
         auto ret = responseJson.get<std::unique_ptr<WebApi_User>>();
 
         userCache_.CacheObject( *ret );
@@ -86,140 +252,116 @@ std::unique_ptr<const sptf::WebApi_User> WebApi_Backend::GetUser( abort_callback
     }
 }
 
-void WebApi_Backend::RefreshCacheForTracks( nonstd::span<const std::string> trackIds, abort_callback& abort )
+void WebApi_Backend::RefreshCacheForTracks( nonstd::span<const std::string> trackIds, abort_callback& abort, RequestPriority priority )
 {
-    constexpr size_t kMaxItemsPerRequest = 50;
-
-    // remove duplicates
-    const auto uniqueIds = trackIds | ranges::to<std::unordered_set<std::string>>;
-
-    for ( const auto& trackIdsChunk:
-          uniqueIds
-              | ranges::views::remove_if( [&]( const auto& id ) { return trackCache_.IsCached( id ); } )
-              | ranges::views::chunk( kMaxItemsPerRequest ) )
-    {
-        const auto trackIdsStr = qwr::unicode::ToWide( qwr::string::Join( trackIdsChunk | ranges::to_vector, ',' ) );
-
-        web::uri_builder builder;
-        builder
-            .append_path( L"tracks" )
-            .append_query( L"ids", trackIdsStr );
-
-        const auto responseJson = GetJsonResponse( builder.to_uri(), abort );
-        const auto tracksIt = responseJson.find( "tracks" );
-        qwr::QwrException::ExpectTrue( responseJson.cend() != tracksIt,
-                                       L"Malformed track data response response: missing `tracks`" );
+    WaitForTask( abortManager_, abort, [&]( auto token ) { return RefreshCacheForTracksAsync( trackIds, priority, token ); } );
+}
 
-        auto ret = tracksIt->get<std::vector<std::unique_ptr<const WebApi_Track>>>();
-        trackCache_.CacheObjects( ret );
-    }
+pplx::task<void>
+WebApi_Backend::RefreshCacheForTracksAsync( nonstd::span<const std::string> trackIds, RequestPriority priority, pplx::cancellation_token token )
+{
+    return ProcessChunksAsync(
+        trackCache_.GetUncachedIds( trackIds ),
+        kMaxItemsPerBatchRequest,
+        kMaxConcurrentBatchRequests,
+        [this, priority, token]( nonstd::span<const std::string> trackIdsChunk ) {
+            const auto trackIdsStr = qwr::unicode::ToWide( qwr::string::Join( trackIdsChunk | ranges::to_vector, ',' ) );
+
+            web::uri_builder builder;
+            builder
+                .append_path( L"tracks" )
+                .append_query( L"ids", trackIdsStr );
+
+            return GetJsonResponseAsync( builder.to_uri(), priority, token, &GetTracksJsonFilter() )
+                .then( [this]( std::shared_ptr<const nlohmann::json> pResponseJson ) {
+                    const auto tracksIt = pResponseJson->find( "tracks" );
+                    qwr::QwrException::ExpectTrue( pResponseJson->cend() != tracksIt,
+                                                   L"Malformed track data response response: missing `tracks`" );
+
+                    const auto ret = tracksIt->get<std::vector<std::shared_ptr<const WebApi_Track>>>();
+                    trackCache_.CacheObjects( ret );
+                } );
+        } );
 }
 
-std::unique_ptr<const sptf::WebApi_Track>
+std::shared_ptr<const sptf::WebApi_Track>
 WebApi_Backend::GetTrack( const std::string& trackId, abort_callback& abort, bool useRelink )
 {
     // don't want to cache relinked tracks
 
-    if ( auto trackOpt = trackCache_.GetObjectFromCache( trackId );
-         !useRelink && trackOpt )
+    if ( !useRelink && FetchWithBatcher( trackBatcher_, trackCache_, trackId, abort ) )
     {
-        return std::unique_ptr<sptf::WebApi_Track>( std::move( *trackOpt ) );
+        if ( auto pTrack = trackCache_.GetObjectFromCache( trackId );
+             pTrack )
+        {
+            return pTrack;
+        }
     }
-    else
+
+    web::uri_builder builder;
+    builder
+        .append_path( L"tracks" )
+        .append_path( qwr::unicode::ToWide( trackId ) );
+    if ( useRelink )
     {
-        web::uri_builder builder;
-        builder
-            .append_path( L"tracks" )
-            .append_path( qwr::unicode::ToWide( trackId ) );
-        if ( useRelink )
+        if ( const auto countryOpt = GetUser( abort )->country;
+             countryOpt )
         {
-            if ( const auto countryOpt = GetUser( abort )->country;
-                 countryOpt )
-            {
-                builder.append_query( L"market", qwr::unicode::ToWide( *countryOpt ) );
-            }
+            builder.append_query( L"market", qwr::unicode::ToWide( *countryOpt ) );
         }
+    }
 
-        const auto responseJson = GetJsonResponse( builder.to_uri(), abort );
-        auto ret = responseJson.get<std::unique_ptr<WebApi_Track>>();
+    const auto responseJson = GetJsonResponse( builder.to_uri(), RequestPriority::interactive, abort, &GetTrackJsonFilter() );
+    auto ret = responseJson.get<std::shared_ptr<const WebApi_Track>>();
 
-        if ( !useRelink )
-        {
-            trackCache_.CacheObject( *ret );
-        }
-        return std::unique_ptr<sptf::WebApi_Track>( std::move( ret ) );
+    if ( !useRelink )
+    {
+        trackCache_.CacheObject( ret );
     }
+    return ret;
 }
 
-std::vector<std::unique_ptr<const WebApi_Track>>
+std::vector<std::shared_ptr<const WebApi_Track>>
 WebApi_Backend::GetTracks( nonstd::span<const std::string> trackIds, abort_callback& abort )
 {
     RefreshCacheForTracks( trackIds, abort );
 
-    return trackIds | ranges::views::transform( [&]( const auto& id ) -> std::unique_ptr<const WebApi_Track> {
-               assert( trackCache_.IsCached( id ) );
-               return std::move( *trackCache_.GetObjectFromCache( id ) );
-           } )
+    return trackIds | ranges::views::transform( [&]( const auto& id ) { return GetCachedObject( trackCache_, id ); } )
            | ranges::to_vector;
 }
 
-std::tuple<
-    std::vector<std::unique_ptr<const WebApi_Track>>,
-    std::vector<std::unique_ptr<const WebApi_LocalTrack>>>
-WebApi_Backend::GetTracksFromPlaylist( const std::string& playlistId, abort_callback& abort )
+pplx::task<std::vector<std::shared_ptr<const WebApi_Track>>>
+WebApi_Backend::GetTracksAsync( std::vector<std::string> trackIds, pplx::cancellation_token token )
 {
-    constexpr size_t kMaxItemsPerRequest = 100;
-
-    auto requestUri = [&] {
-        web::uri_builder builder;
-        builder
-            .append_path( fmt::format( L"playlists/{}/tracks", qwr::unicode::ToWide( playlistId ) ) )
-            .append_query( L"limit", kMaxItemsPerRequest, false );
-
-        return builder.to_uri();
-    }();
-
-    std::vector<std::unique_ptr<const WebApi_Track>> tracks;
-    std::vector<std::unique_ptr<const WebApi_LocalTrack>> localTracks;
-    while ( true )
-    {
-        const auto responseJson = GetJsonResponse( requestUri, abort );
-        const auto pPagingObject = responseJson.get<std::unique_ptr<const WebApi_PagingObject>>();
-
-        auto playlistTracks = pPagingObject->items.get<std::vector<std::unique_ptr<WebApi_PlaylistTrack>>>();
-        for ( auto& playlistTrack: playlistTracks )
-        {
-            std::visit( [&]( auto&& arg ) {
-                using T = std::decay_t<decltype( arg )>;
-                if constexpr ( std::is_same_v<T, WebApi_Track> )
-                {
-                    tracks.emplace_back( std::make_unique<T>( std::move( arg ) ) );
-                }
-                else if constexpr ( std::is_same_v<T, WebApi_LocalTrack> )
-                {
-                    localTracks.emplace_back( std::make_unique<T>( std::move( arg ) ) );
-                }
-                else
-                {
-                    static_assert( qwr::always_false_v<T>, "non-exhaustive visitor!" );
-                }
-            },
-                        *playlistTrack->track );
-        }
-
-        if ( !pPagingObject->next )
-        {
-            break;
-        }
+    auto task = RefreshCacheForTracksAsync( trackIds, RequestPriority::background, token );
+    return task.then( [this, trackIds = std::move( trackIds )] {
+        return trackIds | ranges::views::transform( [&]( const auto& id ) { return GetCachedObject( trackCache_, id ); } )
+               | ranges::to_vector;
+    } );
+}
 
-        requestUri = *pPagingObject->next;
-    }
+void WebApi_Backend::GetTracksFromPlaylist( const std::string& playlistId, const PlaylistTracksProcessor& processTracks, abort_callback& abort )
+{
+    ProcessPages(
+        GetPlaylistTracksUri( playlistId ),
+        kMaxPlaylistItemsPerRequest,
+        &GetPlaylistPageJsonFilter(),
+        [&]( const auto& pagingObject ) { ProcessPlaylistPage( pagingObject, processTracks ); },
+        abort );
+}
 
-    trackCache_.CacheObjects( tracks );
-    return { std::move( tracks ), std::move( localTracks ) };
+pplx::task<void>
+WebApi_Backend::GetTracksFromPlaylistAsync( const std::string& playlistId, PlaylistTracksProcessor processTracks, pplx::cancellation_token token )
+{
+    return ProcessPagesAsync(
+        GetPlaylistTracksUri( playlistId ),
+        kMaxPlaylistItemsPerRequest,
+        &GetPlaylistPageJsonFilter(),
+        [this, processTracks = std::move( processTracks )]( const auto& pagingObject ) { ProcessPlaylistPage( pagingObject, processTracks ); },
+        token );
 }
 
-std::vector<std::unique_ptr<const sptf::WebApi_Track>>
+std::vector<std::shared_ptr<const sptf::WebApi_Track>>
 WebApi_Backend::GetTracksFromAlbum( const std::string& albumId, abort_callback& abort )
 {
     std::shared_ptr<WebApi_Album_Simplified> album;
@@ -233,7 +375,7 @@ WebApi_Backend::GetTracksFromAlbum( const std::string& albumId, abort_callback&
                 web::uri_builder builder;
                 builder.append_path( fmt::format( L"albums/{}", qwr::unicode::ToWide( albumId ) ) );
 
-                const auto responseJson = GetJsonResponse( builder.to_uri(), abort );
+                const auto responseJson = GetJsonResponse( builder.to_uri(), RequestPriority::background, abort );
                 responseJson.get_to( album );
 
                 const auto tracksIt = responseJson.find( "tracks" );
@@ -244,7 +386,7 @@ WebApi_Backend::GetTracksFromAlbum( const std::string& albumId, abort_callback&
             }
             else
             {
-                return GetJsonResponse( requestUri, abort );
+                return GetJsonResponse( requestUri, RequestPriority::background, abort );
             }
         }();
 
@@ -261,15 +403,15 @@ WebApi_Backend::GetTracksFromAlbum( const std::string& albumId, abort_callback&
         requestUri = *pPagingObject->next;
     }
 
-    auto newRet = ranges::views::transform( ret, [&]( auto&& elem ) {
-                      return std::make_unique<const WebApi_Track>( std::move( elem ), album );
+    auto newRet = ranges::views::transform( ret, [&]( auto&& elem ) -> std::shared_ptr<const WebApi_Track> {
+                      return std::make_shared<const WebApi_Track>( std::move( elem ), album );
                   } )
                   | ranges::to_vector;
     trackCache_.CacheObjects( newRet );
     return newRet;
 }
 
-std::vector<std::unique_ptr<const WebApi_Track>>
+std::vector<std::shared_ptr<const WebApi_Track>>
 WebApi_Backend::GetTopTracksForArtist( const std::string& artistId, abort_callback& abort )
 {
     const auto countryOpt = GetUser( abort )->country;
@@ -284,19 +426,19 @@ WebApi_Backend::GetTopTracksForArtist( const std::string& artistId, abort_callba
         .append_path( L"top-tracks" )
         .append_query( L"market", qwr::unicode::ToWide( *countryOpt ) );
 
-    const auto responseJson = GetJsonResponse( builder.to_uri(), abort );
+    const auto responseJson = GetJsonResponse( builder.to_uri(), RequestPriority::background, abort );
 
     const auto tracksIt = responseJson.find( "tracks" );
     qwr::QwrException::ExpectTrue( responseJson.cend() != tracksIt,
                                    L"Malformed track data response response: missing `tracks`" );
 
-    auto ret = tracksIt->get<std::vector<std::unique_ptr<const WebApi_Track>>>();
+    auto ret = tracksIt->get<std::vector<std::shared_ptr<const WebApi_Track>>>();
     trackCache_.CacheObjects( ret );
     return ret;
 }
 
 std::vector<std::unordered_multimap<std::string, std::string>>
-WebApi_Backend::GetMetaForTracks( nonstd::span<const std::unique_ptr<const WebApi_Track>> tracks )
+WebApi_Backend::GetMetaForTracks( nonstd::span<const std::shared_ptr<const WebApi_Track>> tracks )
 {
     std::vector<std::unordered_multimap<std::string, std::string>> ret;
     for ( const auto& track: tracks )
@@ -331,53 +473,59 @@ WebApi_Backend::GetMetaForTracks( nonstd::span<const std::unique_ptr<const WebAp
     return ret;
 }
 
-void WebApi_Backend::RefreshCacheForArtists( nonstd::span<const std::string> artistIds, abort_callback& abort )
+void WebApi_Backend::RefreshCacheForArtists( nonstd::span<const std::string> artistIds, abort_callback& abort, RequestPriority priority )
 {
-    // remove duplicates
-    const auto uniqueIds = artistIds | ranges::to<std::unordered_set<std::string>>;
-
-    for ( const auto& idsChunk:
-          uniqueIds
-              | ranges::views::remove_if( [&]( const auto& id ) { return artistCache_.IsCached( id ); } )
-              | ranges::views::chunk( 50 ) )
-    {
-        const auto idsStr = qwr::unicode::ToWide( qwr::string::Join( idsChunk | ranges::to_vector, ',' ) );
-
-        web::uri_builder builder;
-        builder
-            .append_path( L"artists" )
-            .append_query( L"ids", idsStr );
-
-        const auto responseJson = GetJsonResponse( builder.to_uri(), abort );
-        const auto artistsIt = responseJson.find( "artists" );
-        qwr::QwrException::ExpectTrue( responseJson.cend() != artistsIt,
-                                       L"Malformed track data response response: missing `artists`" );
+    WaitForTask( abortManager_, abort, [&]( auto token ) { return RefreshCacheForArtistsAsync( artistIds, priority, token ); } );
+}
 
-        auto ret = artistsIt->get<std::vector<std::unique_ptr<const WebApi_Artist>>>();
-        artistCache_.CacheObjects( ret );
-    }
+pplx::task<void>
+WebApi_Backend::RefreshCacheForArtistsAsync( nonstd::span<const std::string> artistIds, RequestPriority priority, pplx::cancellation_token token )
+{
+    return ProcessChunksAsync(
+        artistCache_.GetUncachedIds( artistIds ),
+        kMaxItemsPerBatchRequest,
+        kMaxConcurrentBatchRequests,
+        [this, priority, token]( nonstd::span<const std::string> idsChunk ) {
+            const auto idsStr = qwr::unicode::ToWide( qwr::string::Join( idsChunk | ranges::to_vector, ',' ) );
+
+            web::uri_builder builder;
+            builder
+                .append_path( L"artists" )
+                .append_query( L"ids", idsStr );
+
+            return GetJsonResponseAsync( builder.to_uri(), priority, token )
+                .then( [this]( std::shared_ptr<const nlohmann::json> pResponseJson ) {
+                    const auto artistsIt = pResponseJson->find( "artists" );
+                    qwr::QwrException::ExpectTrue( pResponseJson->cend() != artistsIt,
+                                                   L"Malformed track data response response: missing `artists`" );
+
+                    const auto ret = artistsIt->get<std::vector<std::shared_ptr<const WebApi_Artist>>>();
+                    artistCache_.CacheObjects( ret );
+                } );
+        } );
 }
 
-std::unique_ptr<const WebApi_Artist>
+std::shared_ptr<const WebApi_Artist>
 WebApi_Backend::GetArtist( const std::string& artistId, abort_callback& abort )
 {
-    if ( auto objectOpt = artistCache_.GetObjectFromCache( artistId );
-         objectOpt )
-    {
-        return std::unique_ptr<const WebApi_Artist>( std::move( *objectOpt ) );
-    }
-    else
+    if ( FetchWithBatcher( artistBatcher_, artistCache_, artistId, abort ) )
     {
-        web::uri_builder builder;
-        builder
-            .append_path( L"artists" )
-            .append_path( qwr::unicode::ToWide( artistId ) );
-
-        const auto responseJson = GetJsonResponse( builder.to_uri(), abort );
-        auto ret = responseJson.get<std::unique_ptr<const WebApi_Artist>>();
-        artistCache_.CacheObject( *ret );
-        return std::unique_ptr<const WebApi_Artist>( std::move( ret ) );
+        if ( auto pArtist = artistCache_.GetObjectFromCache( artistId );
+             pArtist )
+        {
+            return pArtist;
+        }
     }
+
+    web::uri_builder builder;
+    builder
+        .append_path( L"artists" )
+        .append_path( qwr::unicode::ToWide( artistId ) );
+
+    const auto responseJson = GetJsonResponse( builder.to_uri(), RequestPriority::interactive, abort );
+    auto ret = responseJson.get<std::shared_ptr<const WebApi_Artist>>();
+    artistCache_.CacheObject( ret );
+    return ret;
 }
 
 fs::path WebApi_Backend::GetAlbumImage( const std::string& albumId, const std::string& imgUrl, abort_callback& abort )
@@ -408,84 +556,399 @@ web::http::client::http_client_config WebApi_Backend::GetClientConfig()
         config.set_proxy( std::move( proxy ) );
     }
 
+    // decompression is performed by the client
+    config.set_request_compressed_response( sptf::config::advanced::network_compression );
+    config.set_timeout( std::chrono::seconds( sptf::config::advanced::network_timeout.GetValue() ) );
+    config.set_chunksize( static_cast<size_t>( sptf::config::advanced::network_chunk_size.GetValue() ) * 1024 );
+
     return config;
 }
 
-nlohmann::json WebApi_Backend::GetJsonResponse( const web::uri& requestUri, abort_callback& abort )
+pplx::task<std::shared_ptr<const WebApi_PagingObject>>
+WebApi_Backend::GetPageAsync( const web::uri& requestUri, size_t itemsPerPage, size_t offset, const WebApi_JsonFilter* pFilter, pplx::cancellation_token token )
 {
-    return ParseResponse( GetResponse( requestUri, abort ) );
+    web::uri_builder builder( requestUri );
+    builder
+        .append_query( L"limit", itemsPerPage, false )
+        .append_query( L"offset", offset, false );
+
+    return GetJsonResponseAsync( builder.to_uri(), RequestPriority::background, token, pFilter )
+        .then( []( std::shared_ptr<const nlohmann::json> pResponseJson ) {
+            return pResponseJson->get<std::shared_ptr<const WebApi_PagingObject>>();
+        } );
 }
 
-web::http::http_response WebApi_Backend::GetResponse( const web::uri& requestUri, abort_callback& abort )
+void WebApi_Backend::ProcessPages( const web::uri& requestUri, size_t itemsPerPage, const WebApi_JsonFilter* pFilter, const std::function<void( const WebApi_PagingObject& )>& processPage, abort_callback& abort )
 {
-    const auto adjustedRequestUri = [&] {
-        const auto uriStr = requestUri.to_string();
-        const auto baseUriStr = client_.base_uri().to_string();
-        if ( uriStr._Starts_with( baseUriStr ) )
+    // first page is needed to get the total number of items
+    const auto pFirstPage = WaitForTask( abortManager_, abort, [&]( auto token ) { return GetPageAsync( requestUri, itemsPerPage, 0, pFilter, token ); } );
+    const auto total = pFirstPage->total;
+    processPage( *pFirstPage );
+
+    // requests are throttled by `rpsLimiter_` anyway,
+    // but we still need to limit the number of pages that are kept in memory
+    pplx::cancellation_token_source cts;
+    const auto abortableScope = abortManager_.GetAbortableScope( [&cts] { cts.cancel(); }, abort );
+    std::deque<pplx::task<std::shared_ptr<const WebApi_PagingObject>>> pendingPages;
+    const qwr::final_action autoWait( [&] {
+        // might have pending tasks only on error
+        cts.cancel();
+        for ( auto& task: pendingPages )
         {
-            return web::uri{ uriStr.data() + baseUriStr.size() };
+            try
+            {
+                task.wait();
+            }
+            catch ( ... )
+            {
+            }
         }
-        else
+    } );
+
+    size_t nextOffset = itemsPerPage;
+    const auto requestNextPage = [&] {
+        if ( nextOffset >= total )
         {
-            return requestUri;
+            return;
         }
-    }();
 
-    if ( shouldLogWebApiRequest_ )
+        pendingPages.emplace_back( GetPageAsync( requestUri, itemsPerPage, nextOffset, pFilter, cts.get_token() ) );
+        nextOffset += itemsPerPage;
+    };
+
+    for ( size_t i = 0; i < kMaxConcurrentPageRequests; ++i )
     {
-        FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (debug): request:\n"
-                                 << qwr::unicode::ToU8( adjustedRequestUri.to_string() );
+        requestNextPage();
+    }
+
+    while ( !pendingPages.empty() )
+    {
+        const auto pPage = [&] {
+            try
+            {
+                return pendingPages.front().get();
+            }
+            catch ( const pplx::task_canceled& )
+            { // same as in `WaitForTask`
+                throw qwr::QwrException( "Abort was signaled, canceling request..." );
+            }
+        }();
+        pendingPages.pop_front();
+
+        requestNextPage();
+        processPage( *pPage );
+    }
+}
+
+pplx::task<void>
+WebApi_Backend::ProcessPagesAsync( const web::uri& requestUri, size_t itemsPerPage, const WebApi_JsonFilter* pFilter, std::function<void( const WebApi_PagingObject& )> processPage, pplx::cancellation_token token )
+{
+    using PageEvent = pplx::task_completion_event<std::shared_ptr<const WebApi_PagingObject>>;
+
+    // first page is needed to get the total number of items
+    return GetPageAsync( requestUri, itemsPerPage, 0, pFilter, token )
+        .then( [this, requestUri, itemsPerPage, pFilter, processPage, token]( std::shared_ptr<const WebApi_PagingObject> pFirstPage ) {
+            processPage( *pFirstPage );
+
+            const auto pageCount = ( pFirstPage->total + itemsPerPage - 1 ) / itemsPerPage;
+            const auto pPageEvents = std::make_shared<std::vector<PageEvent>>( pageCount );
+
+            // pages are requested only when there is a free slot, see `ProcessPages`
+            const auto requestPage = [this, requestUri, itemsPerPage, pFilter, token, pPageEvents]( size_t pageIdx ) {
+                if ( pageIdx >= pPageEvents->size() )
+                {
+                    return;
+                }
+
+                GetPageAsync( requestUri, itemsPerPage, pageIdx * itemsPerPage, pFilter, token )
+                    .then( [pageEvent = ( *pPageEvents )[pageIdx]]( pplx::task<std::shared_ptr<const WebApi_PagingObject>> task ) {
+                        try
+                        {
+                            pageEvent.set( task.get() );
+                        }
+                        catch ( ... )
+                        {
+                            pageEvent.set_exception( std::current_exception() );
+                        }
+                    } );
+            };
+
+            for ( size_t i = 1; i <= kMaxConcurrentPageRequests; ++i )
+            {
+                requestPage( i );
+            }
+
+            auto processChain = pplx::task_from_result();
+            for ( size_t i = 1; i < pageCount; ++i )
+            {
+                processChain = processChain
+                                   .then( [pageEvent = ( *pPageEvents )[i]] { return pplx::create_task( pageEvent ); } )
+                                   .then( [processPage, requestPage, i]( std::shared_ptr<const WebApi_PagingObject> pPage ) {
+                                       requestPage( i + kMaxConcurrentPageRequests );
+                                       processPage( *pPage );
+                                   } );
+            }
+            return processChain;
+        } );
+}
+
+void WebApi_Backend::ProcessPlaylistPage( const WebApi_PagingObject& page, const PlaylistTracksProcessor& processTracks )
+{
+    std::vector<std::shared_ptr<const WebApi_Track>> tracks;
+    std::vector<std::unique_ptr<const WebApi_LocalTrack>> localTracks;
+
+    auto playlistTracks = page.items.get<std::vector<std::unique_ptr<WebApi_PlaylistTrack>>>();
+    for ( auto& playlistTrack: playlistTracks )
+    {
+        std::visit( [&]( auto&& arg ) {
+            using T = std::decay_t<decltype( arg )>;
+            if constexpr ( std::is_same_v<T, WebApi_Track> )
+            {
+                tracks.emplace_back( std::make_shared<const T>( std::move( arg ) ) );
+            }
+            else if constexpr ( std::is_same_v<T, WebApi_LocalTrack> )
+            {
+                localTracks.emplace_back( std::make_unique<T>( std::move( arg ) ) );
+            }
+            else
+            {
+                static_assert( qwr::always_false_v<T>, "non-exhaustive visitor!" );
+            }
+        },
+                    *playlistTrack->track );
     }
 
-    web::http::http_request req( web::http::methods::GET );
-    req.headers().add( L"Authorization", fmt::format( L"Bearer {}", pAuth_->GetAccessToken( abort ) ) );
-    req.headers().add( L"Accept", L"application/json" );
-    req.headers().set_content_type( L"application/json" );
+    trackCache_.CacheObjects( tracks );
+    processTracks( std::move( tracks ), std::move( localTracks ) );
+}
+
+nlohmann::json WebApi_Backend::GetJsonResponse( const web::uri& requestUri, RequestPriority priority, abort_callback& abort, const WebApi_JsonFilter* pFilter )
+{
+    return *WaitForTask( abortManager_, abort, [&]( auto token ) { return GetJsonResponseAsync( requestUri, priority, token, pFilter ); } );
+}
 
-    req.set_request_uri( adjustedRequestUri );
+pplx::task<std::shared_ptr<const nlohmann::json>>
+WebApi_Backend::GetJsonResponseAsync( const web::uri& requestUri, RequestPriority priority, pplx::cancellation_token token, const WebApi_JsonFilter* pFilter )
+{
+    const auto key = NormalizeUri( requestUri );
+    auto pRequest = AcquireSharedRequest( key, requestUri, priority, pFilter );
 
-    rpsLimiter_.WaitForRequestAvailability( abort );
-    qwr::QwrException::ExpectTrue( !abort.is_aborting(), "Abort was signaled, canceling request..." );
+    pplx::task_completion_event<std::shared_ptr<const nlohmann::json>> resultEvent;
 
-    auto ctsToken = cts_.get_token();
-    auto localCts = Concurrency::cancellation_token_source::create_linked_source( ctsToken );
-    const auto abortableScope = abortManager_.GetAbortableScope( [&localCts] { localCts.cancel(); }, abort );
+    // caller leaves either on completion or on cancellation, whichever comes first
+    const auto pHasLeft = std::make_shared<std::atomic_bool>( false );
+    const auto leave = [this, key, pRequest, pHasLeft] {
+        if ( pHasLeft->exchange( true ) )
+        {
+            return false;
+        }
+        ReleaseSharedRequest( key, pRequest );
+        return true;
+    };
 
-    web::http::http_response response;
-    for ( size_t i = 0; i < 3; ++i )
+    pplx::cancellation_token_registration registration;
+    if ( token.is_cancelable() )
     {
-        response = client_.request( req, localCts.get_token() ).get();
-        if ( response.status_code() != 429 )
+        registration = token.register_callback( [leave, resultEvent] {
+            if ( leave() )
+            {
+                resultEvent.set_exception( std::make_exception_ptr( qwr::QwrException( "Abort was signaled, canceling request..." ) ) );
+            }
+        } );
+    }
+
+    pRequest->task.then( [pRequest, leave, resultEvent, token, registration] {
+        if ( token.is_cancelable() )
         {
-            break;
+            token.deregister_callback( registration );
+        }
+        if ( !leave() )
+        {
+            return;
         }
 
-        const auto it = response.headers().find( L"Retry-After" );
-        qwr::QwrException::ExpectTrue( it != response.headers().end(), "Request failed with 429 error, but does not contain a `Retry-After` header" );
+        if ( pRequest->pError )
+        {
+            resultEvent.set_exception( pRequest->pError );
+        }
+        else
+        {
+            assert( pRequest->pResult );
+            resultEvent.set( pRequest->pResult );
+        }
+    } );
+
+    return pplx::create_task( resultEvent );
+}
 
-        const auto& [_, retryHeader] = *it;
-        const auto retryInMsOpt = qwr::string::GetNumber<uint32_t>( qwr::unicode::ToU8( retryHeader ) );
-        qwr::QwrException::ExpectTrue( retryInMsOpt.has_value(), "Request failed with 429 error, but does not contain a valid number in `Retry-After` header" );
+std::shared_ptr<WebApi_Backend::SharedRequest>
+WebApi_Backend::AcquireSharedRequest( const std::wstring& key, const web::uri& requestUri, RequestPriority priority, const WebApi_JsonFilter* pFilter )
+{
+    auto [pRequest, isNew] = [&] {
+        std::lock_guard lock( sharedRequestsMutex_ );
 
-        const auto retryIn = std::chrono::milliseconds( *retryInMsOpt ) + std::chrono::seconds( 1 );
-        FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (error):\n"
-                                 << fmt::format( L"Rate limit reached: retrying in {} ms", retryIn.count() );
-        if ( !SleepFor( retryIn, abort ) )
+        auto& pRequest = sharedRequests_[key];
+        const bool isNew = !pRequest;
+        if ( isNew )
         {
-            break;
+            pRequest = std::make_shared<SharedRequest>();
+        }
+
+        ++pRequest->waiterCount;
+        return std::make_tuple( pRequest, isNew );
+    }();
+
+    if ( isNew )
+    { // continuations might be executed inline, so the request must be started outside of the lock;
+        // it also has its own cancellation, so that it does not depend on any single caller
+        GetResponseAsync( requestUri, priority, pRequest->abort, pRequest->cts.get_token() )
+            .then( []( web::http::http_response response ) {
+                return response.content_ready();
+            } )
+            .then( [this, pFilter]( web::http::http_response response ) {
+                return std::make_shared<const nlohmann::json>( ParseResponse( response, pFilter ) );
+            } )
+            .then( [this, pRequest = pRequest, key]( pplx::task<std::shared_ptr<const nlohmann::json>> task ) {
+                try
+                {
+                    pRequest->pResult = task.get();
+                }
+                catch ( ... )
+                {
+                    pRequest->pError = std::current_exception();
+                }
+
+                {
+                    std::lock_guard lock( sharedRequestsMutex_ );
+                    pRequest->isDone = true;
+                    if ( auto it = sharedRequests_.find( key ); it != sharedRequests_.end() && it->second == pRequest )
+                    {
+                        sharedRequests_.erase( it );
+                    }
+                }
+                pRequest->doneEvent.set();
+            } );
+    }
+
+    return pRequest;
+}
+
+void WebApi_Backend::ReleaseSharedRequest( const std::wstring& key, const std::shared_ptr<SharedRequest>& pRequest )
+{
+    {
+        std::lock_guard lock( sharedRequestsMutex_ );
+
+        --pRequest->waiterCount;
+        if ( pRequest->isDone || pRequest->waiterCount )
+        {
+            return;
+        }
+
+        if ( auto it = sharedRequests_.find( key ); it != sharedRequests_.end() && it->second == pRequest )
+        { // new callers should not join the aborted request
+            sharedRequests_.erase( it );
         }
     }
 
-    if ( response.status_code() == 429 )
+    // nobody needs the result anymore
+    pRequest->abort.abort();
+    pRequest->cts.cancel();
+}
+
+web::uri WebApi_Backend::ToRelativeUri( const web::uri& requestUri ) const
+{
+    const auto uriStr = requestUri.to_string();
+    const auto baseUriStr = client_.base_uri().to_string();
+    if ( uriStr._Starts_with( baseUriStr ) )
+    {
+        return web::uri{ uriStr.data() + baseUriStr.size() };
+    }
+    else
+    {
+        return requestUri;
+    }
+}
+
+std::wstring WebApi_Backend::NormalizeUri( const web::uri& requestUri ) const
+{
+    const auto relativeUri = ToRelativeUri( requestUri );
+
+    auto normalizedUri = relativeUri.path();
+    bool isFirstParam = true;
+    // `split_query` returns a sorted map
+    for ( const auto& [key, value]: web::uri::split_query( relativeUri.query() ) )
+    {
+        normalizedUri += fmt::format( L"{}{}={}", ( isFirstParam ? L'?' : L'&' ), key, value );
+        isFirstParam = false;
+    }
+
+    return normalizedUri;
+}
+
+pplx::task<web::http::http_response>
+WebApi_Backend::GetResponseAsync( const web::uri& requestUri, RequestPriority priority, abort_callback& abort, pplx::cancellation_token token, size_t attempt )
+{
+    const auto adjustedRequestUri = ToRelativeUri( requestUri );
+
+    if ( shouldLogWebApiRequest_ && !attempt )
     {
-        FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (error):\n"
-                                 << fmt::format( L"Rate limit reached: retry failed" );
+        FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (debug): request:\n"
+                                 << qwr::unicode::ToU8( adjustedRequestUri.to_string() );
     }
 
-    return response;
+    // rate limiter blocks the thread, but HTTP request itself does not
+    return pplx::create_task( [this, adjustedRequestUri, priority, &abort, token] {
+               web::http::http_request req( web::http::methods::GET );
+               req.headers().add( L"Authorization", fmt::format( L"Bearer {}", pAuth_->GetAccessToken( abort ) ) );
+               req.headers().add( L"Accept", L"application/json" );
+               req.headers().set_content_type( L"application/json" );
+               if ( !isKeepAliveEnabled_ )
+               { // connections are reused by default
+                   req.headers().add( L"Connection", L"close" );
+               }
+
+               req.set_request_uri( adjustedRequestUri );
+
+               rpsLimiter_.WaitForRequestAvailability( priority, abort );
+               qwr::QwrException::ExpectTrue( !abort.is_aborting() && !token.is_canceled(), "Abort was signaled, canceling request..." );
+
+               const std::array tokens{ cts_.get_token(), token };
+               auto localCts = pplx::cancellation_token_source::create_linked_source( tokens.begin(), tokens.end() );
+
+               return client_.request( req, localCts.get_token() );
+           } )
+        .then( [this, requestUri, priority, &abort, token, attempt]( web::http::http_response response ) {
+            if ( response.status_code() != 429 )
+            {
+                rpsLimiter_.OnResponse( response.status_code() );
+                return pplx::task_from_result( response );
+            }
+
+            if ( attempt + 1 >= kMaxRequestAttempts )
+            {
+                FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (error):\n"
+                                         << fmt::format( L"Rate limit reached: retry failed" );
+                return pplx::task_from_result( response );
+            }
+
+            const auto it = response.headers().find( L"Retry-After" );
+            qwr::QwrException::ExpectTrue( it != response.headers().end(), "Request failed with 429 error, but does not contain a `Retry-After` header" );
+
+            const auto& [_, retryHeader] = *it;
+            const auto retryInSecOpt = qwr::string::GetNumber<uint32_t>( qwr::unicode::ToU8( retryHeader ) );
+            qwr::QwrException::ExpectTrue( retryInSecOpt.has_value(), "Request failed with 429 error, but does not contain a valid number in `Retry-After` header" );
+
+            const auto retryIn = std::chrono::milliseconds( std::chrono::seconds( *retryInSecOpt ) ) + std::chrono::seconds( 1 );
+            FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (error):\n"
+                                     << fmt::format( L"Rate limit reached: retrying in {} ms", retryIn.count() );
+
+            // pauses all requests, not just this one: retry will wait for it in the rate limiter
+            rpsLimiter_.OnRateLimited( retryIn );
+            return GetResponseAsync( requestUri, priority, abort, token, attempt + 1 );
+        } );
 }
 
-nlohmann::json WebApi_Backend::ParseResponse( const web::http::http_response& response )
+nlohmann::json WebApi_Backend::ParseResponse( const web::http::http_response& response, const WebApi_JsonFilter* pFilter )
 {
     if ( response.status_code() != 200 )
     {
@@ -506,7 +969,9 @@ nlohmann::json WebApi_Backend::ParseResponse( const web::http::http_response& re
                                  }() );
     }
 
-    const auto responseJson = nlohmann::json::parse( response.extract_string().get() );
+    // raw body is parsed directly: `extract_string` would convert it to UTF-16 first
+    const auto body = response.extract_vector().get();
+    const auto responseJson = ( pFilter ? pFilter->Parse( body ) : nlohmann::json::parse( body ) );
     if ( shouldLogWebApiResponse_ )
     {
         FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (debug): response:\n"
@@ -518,4 +983,41 @@ nlohmann::json WebApi_Backend::ParseResponse( const web::http::http_response& re
     return responseJson;
 }
 
+template <typename T>
+bool WebApi_Backend::FetchWithBatcher( WebApi_RequestBatcher& batcher, WebApi_ObjectCache<T>& cache, const std::string& id, abort_callback& abort )
+{
+    if ( cache.IsCached( id ) || !batcher.IsEnabled() )
+    {
+        return cache.IsCached( id );
+    }
+
+    // batch errors are not retried with single-item requests:
+    // that would multiply the number of requests exactly when the API is failing (e.g. when the rate limit is reached)
+    batcher.Process( id, abort );
+
+    // ids that were not returned by the batch request are retried by the caller
+    return cache.IsCached( id );
+}
+
+template <typename T>
+std::shared_ptr<const T> WebApi_Backend::GetCachedObject( WebApi_ObjectCache<T>& cache, const std::string& id )
+{
+    auto pObject = cache.GetObjectFromCache( id );
+    qwr::QwrException::ExpectTrue( pObject != nullptr, "Failed to get object from cache: `{}`", id );
+    return pObject;
+}
+
+template <typename T>
+void WebApi_Backend::LogCacheStats( std::string_view name, WebApi_ObjectCache<T>& cache )
+{
+    const auto stats = cache.GetStats();
+    FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (debug):\n"
+                             << fmt::format( "{} cache: {} hits, {} misses, {} objects ({} KB) in memory",
+                                             name,
+                                             stats.hits,
+                                             stats.misses,
+                                             stats.itemCount,
+                                             stats.sizeInBytes / 1024 );
+}
+
 } // namespace sptf
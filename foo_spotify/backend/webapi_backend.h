@@ -1,13 +1,17 @@
 #pragma once
 
 #include <backend/webapi_cache.h>
+#include <backend/webapi_request_batcher.h>
 #include <utils/rps_limiter.h>
 
 #include <cpprest/http_client.h>
 #include <nonstd/span.hpp>
 
+#include <exception>
 #include <filesystem>
-#include <tuple>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -15,9 +19,11 @@ namespace sptf
 {
 
 struct WebApi_User;
+struct WebApi_PagingObject;
 struct WebApi_Track;
 struct WebApi_LocalTrack;
 struct WebApi_Artist;
+class WebApi_JsonFilter;
 class WebApiAuthorizer;
 class AbortManager;
 
@@ -33,31 +39,40 @@ public:
 
     std::unique_ptr<const sptf::WebApi_User> GetUser( abort_callback& abort );
 
-    void RefreshCacheForTracks( nonstd::span<const std::string> trackIds, abort_callback& abort );
+    void RefreshCacheForTracks( nonstd::span<const std::string> trackIds, abort_callback& abort, RequestPriority priority = RequestPriority::background );
+    pplx::task<void>
+    RefreshCacheForTracksAsync( nonstd::span<const std::string> trackIds, RequestPriority priority = RequestPriority::background, pplx::cancellation_token token = pplx::cancellation_token::none() );
 
-    std::unique_ptr<const WebApi_Track>
+    std::shared_ptr<const WebApi_Track>
     GetTrack( const std::string& trackId, abort_callback& abort, bool useRelink = false );
 
-    std::vector<std::unique_ptr<const WebApi_Track>>
+    std::vector<std::shared_ptr<const WebApi_Track>>
     GetTracks( nonstd::span<const std::string> trackIds, abort_callback& abort );
-
-    std::tuple<
-        std::vector<std::unique_ptr<const WebApi_Track>>,
-        std::vector<std::unique_ptr<const WebApi_LocalTrack>>>
-    GetTracksFromPlaylist( const std::string& playlistId, abort_callback& abort );
-
-    std::vector<std::unique_ptr<const WebApi_Track>>
+    pplx::task<std::vector<std::shared_ptr<const WebApi_Track>>>
+    GetTracksAsync( std::vector<std::string> trackIds, pplx::cancellation_token token = pplx::cancellation_token::none() );
+
+    using PlaylistTracksProcessor = std::function<void( std::vector<std::shared_ptr<const WebApi_Track>> tracks,
+                                                        std::vector<std::unique_ptr<const WebApi_LocalTrack>> localTracks )>;
+    /// @param processTracks called on the current thread for every received page, in the playlist order
+    void GetTracksFromPlaylist( const std::string& playlistId, const PlaylistTracksProcessor& processTracks, abort_callback& abort );
+    /// @param processTracks called sequentially (but not necessarily on the same thread) for every received page, in the playlist order
+    pplx::task<void>
+    GetTracksFromPlaylistAsync( const std::string& playlistId, PlaylistTracksProcessor processTracks, pplx::cancellation_token token = pplx::cancellation_token::none() );
+
+    std::vector<std::shared_ptr<const WebApi_Track>>
     GetTracksFromAlbum( const std::string& albumId, abort_callback& abort );
 
-    std::vector<std::unique_ptr<const WebApi_Track>>
+    std::vector<std::shared_ptr<const WebApi_Track>>
     GetTopTracksForArtist( const std::string& artistId, abort_callback& abort );
 
     std::vector<std::unordered_multimap<std::string, std::string>>
-    GetMetaForTracks( nonstd::span<const std::unique_ptr<const WebApi_Track>> tracks );
+    GetMetaForTracks( nonstd::span<const std::shared_ptr<const WebApi_Track>> tracks );
 
-    void RefreshCacheForArtists( nonstd::span<const std::string> artistIds, abort_callback& abort );
+    void RefreshCacheForArtists( nonstd::span<const std::string> artistIds, abort_callback& abort, RequestPriority priority = RequestPriority::background );
+    pplx::task<void>
+    RefreshCacheForArtistsAsync( nonstd::span<const std::string> artistIds, RequestPriority priority = RequestPriority::background, pplx::cancellation_token token = pplx::cancellation_token::none() );
 
-    std::unique_ptr<const WebApi_Artist>
+    std::shared_ptr<const WebApi_Artist>
     GetArtist( const std::string& artistId, abort_callback& abort );
 
     std::filesystem::path GetAlbumImage( const std::string& albumId, const std::string& imgUrl, abort_callback& abort );
@@ -66,9 +81,47 @@ public:
 private:
     static web::http::client::http_client_config GetClientConfig();
 
-    nlohmann::json GetJsonResponse( const web::uri& requestUri, abort_callback& abort );
-    web::http::http_response GetResponse( const web::uri& requestUri, abort_callback& abort );
-    nlohmann::json ParseResponse( const web::http::http_response& response );
+    pplx::task<std::shared_ptr<const WebApi_PagingObject>>
+    GetPageAsync( const web::uri& requestUri, size_t itemsPerPage, size_t offset, const WebApi_JsonFilter* pFilter, pplx::cancellation_token token );
+    /// Requests all the pages of the paging object concurrently.
+    ///
+    /// @param requestUri uri without `limit` and `offset` parameters
+    /// @param pFilter see `GetJsonResponse`
+    /// @param processPage void( const WebApi_PagingObject& page ), called on the current thread in the page order
+    /// @throw qwr::QwrException on abort
+    void ProcessPages( const web::uri& requestUri, size_t itemsPerPage, const WebApi_JsonFilter* pFilter, const std::function<void( const WebApi_PagingObject& )>& processPage, abort_callback& abort );
+    /// @param processPage void( const WebApi_PagingObject& page ), called sequentially in the page order
+    pplx::task<void>
+    ProcessPagesAsync( const web::uri& requestUri, size_t itemsPerPage, const WebApi_JsonFilter* pFilter, std::function<void( const WebApi_PagingObject& )> processPage, pplx::cancellation_token token );
+    void ProcessPlaylistPage( const WebApi_PagingObject& page, const PlaylistTracksProcessor& processTracks );
+
+    /// Concurrent requests for the same resource share a single HTTP request (and a single parsed response)
+    /// @param priority is used only by the caller that initiates the request, joined callers don't affect it
+    /// @param pFilter fields that are not accepted by the filter are skipped during parsing,
+    ///                should be the same for all requests with the same uri and should outlive the request
+    nlohmann::json GetJsonResponse( const web::uri& requestUri, RequestPriority priority, abort_callback& abort, const WebApi_JsonFilter* pFilter = nullptr );
+    /// Same as `GetJsonResponse`
+    pplx::task<std::shared_ptr<const nlohmann::json>>
+    GetJsonResponseAsync( const web::uri& requestUri, RequestPriority priority, pplx::cancellation_token token, const WebApi_JsonFilter* pFilter = nullptr );
+    /// @param abort checked while waiting for rate limiter, should be valid until the task is complete
+    /// @param token cancels the HTTP request
+    pplx::task<web::http::http_response>
+    GetResponseAsync( const web::uri& requestUri, RequestPriority priority, abort_callback& abort, pplx::cancellation_token token, size_t attempt = 0 );
+    web::uri ToRelativeUri( const web::uri& requestUri ) const;
+    /// Relative uri with sorted query parameters
+    std::wstring NormalizeUri( const web::uri& requestUri ) const;
+    nlohmann::json ParseResponse( const web::http::http_response& response, const WebApi_JsonFilter* pFilter );
+    /// Tries to fetch object as a part of a batch request.
+    ///
+    /// @return true if object was cached
+    /// @throw std::exception if the batch request has failed
+    template <typename T>
+    bool FetchWithBatcher( WebApi_RequestBatcher& batcher, WebApi_ObjectCache<T>& cache, const std::string& id, abort_callback& abort );
+    /// @throw qwr::QwrException if object is not cached (e.g. server returned no data for it)
+    template <typename T>
+    std::shared_ptr<const T> GetCachedObject( WebApi_ObjectCache<T>& cache, const std::string& id );
+    template <typename T>
+    void LogCacheStats( std::string_view name, WebApi_ObjectCache<T>& cache );
 
 private:
     AbortManager& abortManager_;
@@ -76,6 +129,29 @@ private:
 
     bool shouldLogWebApiRequest_ = false;
     bool shouldLogWebApiResponse_ = false;
+    bool isKeepAliveEnabled_ = true;
+
+    struct SharedRequest
+    {
+        /// set after `isDone`
+        pplx::task_completion_event<void> doneEvent;
+        pplx::task<void> task = pplx::create_task( doneEvent );
+        // both are signaled when there are no waiters left
+        abort_callback_impl abort;
+        pplx::cancellation_token_source cts;
+        size_t waiterCount = 0;
+        bool isDone = false;
+        std::shared_ptr<const nlohmann::json> pResult;
+        std::exception_ptr pError;
+    };
+
+    /// Joins the request or starts a new one
+    std::shared_ptr<SharedRequest> AcquireSharedRequest( const std::wstring& key, const web::uri& requestUri, RequestPriority priority, const WebApi_JsonFilter* pFilter );
+    /// Aborts the request if there are no waiters left
+    void ReleaseSharedRequest( const std::wstring& key, const std::shared_ptr<SharedRequest>& pRequest );
+
+    std::mutex sharedRequestsMutex_;
+    std::unordered_map<std::wstring, std::shared_ptr<SharedRequest>> sharedRequests_;
 
     pplx::cancellation_token_source cts_;
     std::unique_ptr<WebApiAuthorizer> pAuth_;
@@ -85,6 +161,9 @@ private:
     WebApi_ObjectCache<WebApi_Track> trackCache_;
     WebApi_ObjectCache<WebApi_Artist> artistCache_;
 
+    WebApi_RequestBatcher trackBatcher_;
+    WebApi_RequestBatcher artistBatcher_;
+
     WebApi_ImageCache albumImageCache_;
     WebApi_ImageCache artistImageCache_;
 };
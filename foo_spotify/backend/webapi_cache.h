@@ -1,11 +1,22 @@
 #pragma once
 
+#include <backend/webapi_packed_store.h>
+#include <utils/lru_cache.h>
+
 #include <nonstd/span.hpp>
 #include <qwr/file_helpers.h>
+#include <qwr/final_action.h>
 
+#include <algorithm>
+#include <array>
 #include <filesystem>
+#include <iterator>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace sptf
 {
@@ -77,55 +88,342 @@ private:
     std::string cacheSubdir_;
 };
 
+/// Objects are stored on disk in a packed store, recently used ones are also kept in memory.
+/// Cached objects are immutable, so they are shared instead of being copied.
+///
+/// In-memory part is sharded by id hash, each shard has its own lock.
+/// Disk access and (de)serialization are performed outside of shard locks.
+///
+/// Objects are written to disk in background (write-behind):
+/// pending objects are available for lookup right away and are written in batches.
 template <typename T>
 class WebApi_ObjectCache
 {
 public:
-    WebApi_ObjectCache( const std::string& cacheSubdir )
-        : jsonCache_( cacheSubdir )
+    using Stats = typename LruCache<std::string, std::shared_ptr<const T>>::Stats;
+
+    /// @param memoryLimitInBytes limit for the in-memory part of the cache (as measured by the size of stored data)
+    WebApi_ObjectCache( const std::string& cacheSubdir, size_t memoryLimitInBytes )
+        : store_( path::WebApiCache() / "data" / fmt::format( "{}.pack", cacheSubdir ),
+                  path::WebApiCache() / "data" / cacheSubdir )
     {
+        for ( auto& pShard: shards_ )
+        {
+            pShard = std::make_unique<Shard>( memoryLimitInBytes / kShardCount );
+        }
     }
 
-    void CacheObject( const T& object, bool force = false )
+    ~WebApi_ObjectCache()
     {
-        std::lock_guard lock( cacheMutex_ );
-        jsonCache_.CacheObject_NonBlocking( object, object.id, force );
+        try
+        {
+            Flush();
+        }
+        catch ( const std::exception& e )
+        {
+            FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (error):\n"
+                                     << "Failed to write cached objects:\n"
+                                     << e.what();
+        }
+        catch ( ... )
+        {
+            FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (error):\n"
+                                     << "Failed to write cached objects: unknown error";
+        }
     }
 
-    void CacheObjects( const nonstd::span<std::unique_ptr<T>> objects, bool force = false )
+    /// Blocks until all pending objects are written to disk.
+    /// Rethrows the error of the writer if it fails unexpectedly while being waited for.
+    void Flush()
     {
-        std::lock_guard lock( cacheMutex_ );
-        for ( const auto& pObject: objects )
+        while ( true )
         {
-            jsonCache_.CacheObject_NonBlocking( *pObject, pObject->id, force );
+            pplx::task<void> task;
+            {
+                std::shared_lock lock( pendingMutex_ );
+                if ( !isWriterActive_ )
+                {
+                    return;
+                }
+                task = writerTask_;
+            }
+            task.wait();
         }
     }
 
-    void CacheObjects( const nonstd::span<std::unique_ptr<const T>> objects, bool force = false )
+    void CacheObject( std::shared_ptr<const T> pObject, bool force = false )
     {
-        std::lock_guard lock( cacheMutex_ );
+        CacheObjects( nonstd::span<const std::shared_ptr<const T>>( &pObject, 1 ), force );
+    }
+
+    /// Does not wait for objects to be written to disk
+    void CacheObjects( nonstd::span<const std::shared_ptr<const T>> objects, bool force = false )
+    {
+        std::vector<std::shared_ptr<const T>> newObjects;
         for ( const auto& pObject: objects )
         {
-            jsonCache_.CacheObject_NonBlocking( *pObject, pObject->id, force );
+            assert( pObject );
+            if ( force || !IsCached( pObject->id ) )
+            {
+                newObjects.emplace_back( pObject );
+            }
+        }
+
+        if ( newObjects.empty() )
+        {
+            return;
+        }
+
+        if ( force )
+        { // memory cache might contain an outdated object, writer will put the new one there
+            // note: it must be erased before the object is queued, see `GetObjectFromCache`
+            for ( const auto& pObject: newObjects )
+            {
+                auto& shard = GetShard( pObject->id );
+                std::unique_lock lock( shard.mutex );
+                shard.memoryCache.Erase( pObject->id );
+            }
+        }
+
+        std::unique_lock lock( pendingMutex_ );
+        for ( const auto& pObject: newObjects )
+        { // the latest object wins
+            pendingObjects_.insert_or_assign( pObject->id, pObject );
+        }
+
+        if ( !isWriterActive_ )
+        {
+            isWriterActive_ = true;
+            writerTask_ = pplx::create_task( [this] { WritePendingObjects(); } );
         }
     }
 
-    std::optional<std::unique_ptr<T>>
+    /// @return nullptr if object is not cached
+    std::shared_ptr<const T>
     GetObjectFromCache( const std::string& id )
     {
-        std::lock_guard lock( cacheMutex_ );
-        return jsonCache_.GetObjectFromCache_NonBlocking( id );
+        auto& shard = GetShard( id );
+        {
+            // exclusive lock, since LRU order is updated on hit
+            std::unique_lock lock( shard.mutex );
+            if ( auto pObjectOpt = shard.memoryCache.Get( id ) )
+            {
+                return *pObjectOpt;
+            }
+        }
+
+        // pending objects must be checked before the store:
+        // they are removed from the queue only after they are written
+        if ( auto pObject = GetPendingObject( id ) )
+        {
+            return pObject;
+        }
+
+        size_t dataSize = 0;
+        const auto jsonOpt = store_.Get( id, &dataSize );
+        if ( !jsonOpt )
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<const T> pObject;
+        try
+        {
+            pObject = jsonOpt->get<std::shared_ptr<const T>>();
+        }
+        catch ( const nlohmann::detail::exception& )
+        {
+            return nullptr;
+        }
+
+        std::unique_lock lock( shard.mutex );
+        // Don't replace the object that was cached while we were reading.
+        // Pending object is newer than the one we've read: it will be put here by the writer.
+        if ( !shard.memoryCache.Contains( id ) && !GetPendingObject( id ) )
+        {
+            shard.memoryCache.Put( id, pObject, dataSize );
+        }
+
+        return pObject;
     }
 
+    /// Does not access the disk: store index is kept in memory
     bool IsCached( const std::string& id )
     {
-        std::lock_guard lock( cacheMutex_ );
-        return jsonCache_.IsCached_NonBlocking( id );
+        if ( GetPendingObject( id ) || store_.Contains( id ) )
+        {
+            return true;
+        }
+
+        // objects that failed to be written are kept only in memory
+        auto& shard = GetShard( id );
+        std::shared_lock lock( shard.mutex );
+        return shard.memoryCache.Contains( id );
+    }
+
+    /// Same as calling `IsCached` for each id, but cheaper for big batches
+    ///
+    /// @return unique ids that are not cached
+    std::vector<std::string> GetUncachedIds( nonstd::span<const std::string> ids )
+    {
+        std::vector<std::string> notPendingIds;
+        {
+            std::shared_lock lock( pendingMutex_ );
+            std::copy_if( ids.begin(), ids.end(), std::back_inserter( notPendingIds ), [&]( const auto& id ) { return !GetPendingObject_NonBlocking( id ); } );
+        }
+
+        auto uncachedIds = store_.GetMissingKeys( notPendingIds );
+        // objects that failed to be written are kept only in memory
+        uncachedIds.erase( std::remove_if( uncachedIds.begin(), uncachedIds.end(), [&]( const auto& id ) {
+                               auto& shard = GetShard( id );
+                               std::shared_lock lock( shard.mutex );
+                               return shard.memoryCache.Contains( id );
+                           } ),
+                           uncachedIds.end() );
+
+        std::sort( uncachedIds.begin(), uncachedIds.end() );
+        uncachedIds.erase( std::unique( uncachedIds.begin(), uncachedIds.end() ), uncachedIds.end() );
+
+        return uncachedIds;
+    }
+
+    Stats GetStats()
+    {
+        Stats totalStats;
+        for ( const auto& pShard: shards_ )
+        {
+            std::shared_lock lock( pShard->mutex );
+            const auto& stats = pShard->memoryCache.GetStats();
+
+            totalStats.hits += stats.hits;
+            totalStats.misses += stats.misses;
+            totalStats.itemCount += stats.itemCount;
+            totalStats.sizeInBytes += stats.sizeInBytes;
+        }
+
+        return totalStats;
     }
 
 private:
-    std::mutex cacheMutex_;
-    WebApi_JsonCache<T> jsonCache_;
+    struct Shard
+    {
+        Shard( size_t memoryLimitInBytes )
+            : memoryCache( memoryLimitInBytes )
+        {
+        }
+
+        std::shared_mutex mutex;
+        LruCache<std::string, std::shared_ptr<const T>> memoryCache;
+    };
+
+    Shard& GetShard( const std::string& id )
+    {
+        return *shards_[std::hash<std::string>{}( id ) % kShardCount];
+    }
+
+    std::shared_ptr<const T> GetPendingObject( const std::string& id )
+    {
+        std::shared_lock lock( pendingMutex_ );
+        return GetPendingObject_NonBlocking( id );
+    }
+
+    std::shared_ptr<const T> GetPendingObject_NonBlocking( const std::string& id )
+    {
+        if ( const auto it = pendingObjects_.find( id ); it != pendingObjects_.cend() )
+        {
+            return it->second;
+        }
+        if ( const auto it = writingObjects_.find( id ); it != writingObjects_.cend() )
+        {
+            return it->second;
+        }
+        return nullptr;
+    }
+
+    void WritePendingObjects()
+    {
+        bool hasFinished = false;
+        const qwr::final_action autoRestore( [&] {
+            if ( hasFinished )
+            {
+                return;
+            }
+
+            // unexpected error: return unwritten objects to the queue (unless there are newer ones already),
+            // so that the writer can be restarted by the next `CacheObjects` call
+            std::unique_lock lock( pendingMutex_ );
+            pendingObjects_.merge( writingObjects_ );
+            writingObjects_.clear();
+            isWriterActive_ = false;
+        } );
+
+        while ( true )
+        {
+            {
+                std::unique_lock lock( pendingMutex_ );
+                // written objects are already present in the store
+                writingObjects_.clear();
+                if ( pendingObjects_.empty() )
+                {
+                    isWriterActive_ = false;
+                    hasFinished = true;
+                    return;
+                }
+                writingObjects_.swap( pendingObjects_ );
+            }
+
+            // `writingObjects_` is modified only by the writer, so it can be read without lock here
+            std::vector<std::pair<std::string, nlohmann::json>> values;
+            std::vector<size_t> dataSizes;
+            try
+            {
+                values.reserve( writingObjects_.size() );
+                for ( const auto& [id, pObject]: writingObjects_ )
+                {
+                    values.emplace_back( id, nlohmann::json( *pObject ) );
+                }
+
+                dataSizes = store_.Put( values );
+            }
+            catch ( const std::exception& e )
+            { // objects are still kept in memory, so that they are available at least in this session
+                FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (error):\n"
+                                         << "Failed to write cached objects:\n"
+                                         << e.what();
+
+                dataSizes.clear();
+                for ( const auto& [id, value]: values )
+                {
+                    dataSizes.emplace_back( nlohmann::json::to_cbor( value ).size() );
+                }
+                // objects that failed to serialize are accounted by their in-memory size
+                dataSizes.resize( writingObjects_.size(), sizeof( T ) );
+            }
+
+            size_t i = 0;
+            for ( const auto& [id, pObject]: writingObjects_ )
+            {
+                auto& shard = GetShard( id );
+                std::unique_lock lock( shard.mutex );
+                shard.memoryCache.Put( id, pObject, dataSizes[i++] );
+            }
+        }
+    }
+
+private:
+    static constexpr size_t kShardCount = 16;
+
+    WebApi_PackedStore store_;
+    std::array<std::unique_ptr<Shard>, kShardCount> shards_;
+
+    /// guards everything below
+    std::shared_mutex pendingMutex_;
+    bool isWriterActive_ = false;
+    pplx::task<void> writerTask_;
+    /// objects that are waiting to be written
+    std::unordered_map<std::string, std::shared_ptr<const T>> pendingObjects_;
+    /// objects that are being written right now
+    std::unordered_map<std::string, std::shared_ptr<const T>> writingObjects_;
 };
 
 struct WebApi_User;
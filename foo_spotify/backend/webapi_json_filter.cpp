@@ -0,0 +1,294 @@
+#include <stdafx.h>
+
+#include "webapi_json_filter.h"
+
+#include <algorithm>
+
+namespace
+{
+
+/// Same as nlohmann's DOM parser, but skips fields that are not accepted by the filter
+class FilteredDomBuilder
+{
+public:
+    FilteredDomBuilder( nlohmann::json& root, const sptf::WebApi_JsonFilter& filter )
+        : root_( root )
+        , filter_( filter )
+    {
+    }
+
+    bool null()
+    {
+        return HandleValue( nullptr );
+    }
+
+    bool boolean( bool val )
+    {
+        return HandleValue( val );
+    }
+
+    bool number_integer( nlohmann::json::number_integer_t val )
+    {
+        return HandleValue( val );
+    }
+
+    bool number_unsigned( nlohmann::json::number_unsigned_t val )
+    {
+        return HandleValue( val );
+    }
+
+    bool number_float( nlohmann::json::number_float_t val, const nlohmann::json::string_t& )
+    {
+        return HandleValue( val );
+    }
+
+    bool string( nlohmann::json::string_t& val )
+    {
+        return HandleValue( std::move( val ) );
+    }
+
+    bool binary( nlohmann::json::binary_t& val )
+    {
+        return HandleValue( std::move( val ) );
+    }
+
+    bool start_object( size_t )
+    {
+        return StartContainer( nlohmann::json::value_t::object );
+    }
+
+    bool key( nlohmann::json::string_t& val )
+    {
+        if ( skipDepth_ )
+        {
+            return true;
+        }
+
+        assert( !containers_.empty() && containers_.back().pValue->is_object() );
+        const auto& [pObject, nodeIdx] = containers_.back();
+
+        const auto childNodeOpt = filter_.GetChildNode( nodeIdx, val );
+        if ( !childNodeOpt )
+        {
+            isSkippingNextValue_ = true;
+            return true;
+        }
+
+        pNextValue_ = &( *pObject )[std::move( val )];
+        nextNodeIdx_ = *childNodeOpt;
+        return true;
+    }
+
+    bool end_object()
+    {
+        return EndContainer();
+    }
+
+    bool start_array( size_t )
+    {
+        return StartContainer( nlohmann::json::value_t::array );
+    }
+
+    bool end_array()
+    {
+        return EndContainer();
+    }
+
+    template <typename Exception>
+    bool parse_error( size_t, const std::string&, const Exception& ex )
+    {
+        throw ex;
+    }
+
+private:
+    struct Container
+    {
+        nlohmann::json* pValue;
+        /// array elements share the node of the array
+        size_t nodeIdx;
+    };
+
+    /// @return true if the value should be skipped
+    bool ShouldSkip( bool isContainer )
+    {
+        if ( skipDepth_ )
+        {
+            if ( isContainer )
+            {
+                ++skipDepth_;
+            }
+            return true;
+        }
+
+        if ( isSkippingNextValue_ )
+        {
+            isSkippingNextValue_ = false;
+            if ( isContainer )
+            {
+                skipDepth_ = 1;
+            }
+            return true;
+        }
+
+        return false;
+    }
+
+    template <typename Value>
+    nlohmann::json* AddValue( Value&& value )
+    {
+        if ( containers_.empty() )
+        {
+            root_ = nlohmann::json( std::forward<Value>( value ) );
+            nextNodeIdx_ = filter_.GetRootNode();
+            return &root_;
+        }
+
+        auto& [pContainer, nodeIdx] = containers_.back();
+        if ( pContainer->is_array() )
+        {
+            pContainer->emplace_back( std::forward<Value>( value ) );
+            nextNodeIdx_ = nodeIdx;
+            return &pContainer->back();
+        }
+
+        assert( pNextValue_ );
+        *pNextValue_ = nlohmann::json( std::forward<Value>( value ) );
+        return std::exchange( pNextValue_, nullptr );
+    }
+
+    template <typename Value>
+    bool HandleValue( Value&& value )
+    {
+        if ( !ShouldSkip( false ) )
+        {
+            AddValue( std::forward<Value>( value ) );
+        }
+        return true;
+    }
+
+    bool StartContainer( nlohmann::json::value_t type )
+    {
+        if ( !ShouldSkip( true ) )
+        {
+            auto pValue = AddValue( type );
+            containers_.push_back( Container{ pValue, nextNodeIdx_ } );
+        }
+        return true;
+    }
+
+    bool EndContainer()
+    {
+        if ( skipDepth_ )
+        {
+            --skipDepth_;
+            return true;
+        }
+
+        assert( !containers_.empty() );
+        containers_.pop_back();
+        return true;
+    }
+
+private:
+    nlohmann::json& root_;
+    const sptf::WebApi_JsonFilter& filter_;
+
+    std::vector<Container> containers_;
+    nlohmann::json* pNextValue_ = nullptr;
+    size_t nextNodeIdx_ = sptf::WebApi_JsonFilter::kAcceptAll;
+
+    bool isSkippingNextValue_ = false;
+    /// depth of the skipped container
+    size_t skipDepth_ = 0;
+};
+
+} // namespace
+
+namespace sptf
+{
+
+WebApi_JsonFilter::WebApi_JsonFilter( std::string_view fieldsFilter )
+{
+    if ( fieldsFilter.empty() )
+    {
+        nodes_.emplace_back();
+        return;
+    }
+
+    size_t pos = 0;
+    ParseNode( fieldsFilter, pos );
+    qwr::QwrException::ExpectTrue( pos == fieldsFilter.size(), "Malformed fields filter: `{}`", fieldsFilter );
+}
+
+nlohmann::json WebApi_JsonFilter::Parse( nonstd::span<const uint8_t> data ) const
+{
+    nlohmann::json result;
+    FilteredDomBuilder builder( result, *this );
+    nlohmann::json::sax_parse( data.begin(), data.end(), &builder );
+    return result;
+}
+
+size_t WebApi_JsonFilter::GetRootNode() const
+{
+    assert( !nodes_.empty() );
+    return 0;
+}
+
+std::optional<size_t> WebApi_JsonFilter::GetChildNode( size_t nodeIdx, std::string_view name ) const
+{
+    if ( nodeIdx == kAcceptAll )
+    {
+        return kAcceptAll;
+    }
+
+    assert( nodeIdx < nodes_.size() );
+    const auto& children = nodes_[nodeIdx].children;
+    if ( children.empty() )
+    {
+        return kAcceptAll;
+    }
+
+    const auto it = std::find_if( children.cbegin(), children.cend(), [&]( const auto& child ) { return child.first == name; } );
+    if ( it == children.cend() )
+    {
+        return std::nullopt;
+    }
+
+    return it->second;
+}
+
+size_t WebApi_JsonFilter::ParseNode( std::string_view fieldsFilter, size_t& pos )
+{
+    const auto nodeIdx = nodes_.size();
+    nodes_.emplace_back();
+
+    while ( true )
+    {
+        const auto nameEnd = std::min( fieldsFilter.find_first_of( ",()", pos ), fieldsFilter.size() );
+        const auto name = fieldsFilter.substr( pos, nameEnd - pos );
+        qwr::QwrException::ExpectTrue( !name.empty(), "Malformed fields filter: `{}`", fieldsFilter );
+        pos = nameEnd;
+
+        size_t childIdx = kAcceptAll;
+        if ( pos < fieldsFilter.size() && fieldsFilter[pos] == '(' )
+        {
+            ++pos;
+            childIdx = ParseNode( fieldsFilter, pos );
+            qwr::QwrException::ExpectTrue( pos < fieldsFilter.size() && fieldsFilter[pos] == ')', "Malformed fields filter: `{}`", fieldsFilter );
+            ++pos;
+        }
+
+        // `nodes_` might have been reallocated by the recursive call
+        nodes_[nodeIdx].children.emplace_back( std::string( name ), childIdx );
+
+        if ( pos == fieldsFilter.size() || fieldsFilter[pos] != ',' )
+        {
+            break;
+        }
+        ++pos;
+    }
+
+    return nodeIdx;
+}
+
+} // namespace sptf
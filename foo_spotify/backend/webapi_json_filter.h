@@ -0,0 +1,51 @@
+#pragma once
+
+#include <nonstd/span.hpp>
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace sptf
+{
+
+/// Parses json responses, skipping all the fields that are not present in the filter.
+/// Skipped fields are never materialized, which greatly reduces the number of allocations
+/// for responses with big unused fields (e.g. `available_markets`).
+class WebApi_JsonFilter
+{
+public:
+    /// @param fieldsFilter filter in the format of `fields` query parameter (see `GetFieldsFilter`),
+    ///                     filter of an array is applied to each of its elements
+    /// @throw qwr::QwrException on malformed filter
+    WebApi_JsonFilter( std::string_view fieldsFilter );
+    ~WebApi_JsonFilter() = default;
+
+    /// @param data utf-8 encoded json
+    /// @throw nlohmann::json::exception on malformed json
+    nlohmann::json Parse( nonstd::span<const uint8_t> data ) const;
+
+    /// Node that accepts all the fields
+    static constexpr size_t kAcceptAll = static_cast<size_t>( -1 );
+
+    size_t GetRootNode() const;
+    /// @return std::nullopt if the field should be skipped
+    std::optional<size_t> GetChildNode( size_t nodeIdx, std::string_view name ) const;
+
+private:
+    /// @return index of the node
+    size_t ParseNode( std::string_view fieldsFilter, size_t& pos );
+
+private:
+    struct Node
+    {
+        /// empty - all the fields are accepted
+        std::vector<std::pair<std::string, size_t>> children;
+    };
+
+    std::vector<Node> nodes_;
+};
+
+} // namespace sptf
@@ -3,11 +3,13 @@
 #include "webapi_album.h"
 
 #include <backend/webapi_objects/webapi_media_objects.h>
+#include <backend/webapi_objects/webapi_fields_filter.h>
 #include <utils/json_std_extenders.h>
 
 namespace sptf
 {
 
 SPTF_NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE( WebApi_Album_Simplified, artists, images, release_date, name, id );
+SPTF_DEFINE_FIELDS_FILTER( WebApi_Album_Simplified, artists, images, release_date, name, id );
 
 } // namespace sptf
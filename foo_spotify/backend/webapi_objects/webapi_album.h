@@ -28,5 +28,6 @@ struct WebApi_Album_Simplified
 
 void to_json( nlohmann::json& j, const WebApi_Album_Simplified& p );
 void from_json( const nlohmann::json& j, WebApi_Album_Simplified& p );
+std::string GetFieldsFilter( const WebApi_Album_Simplified* );
 
-} // namespace sptf
\ No newline at end of file
+} // namespace sptf
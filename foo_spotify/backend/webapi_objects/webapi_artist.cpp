@@ -3,12 +3,14 @@
 #include "webapi_artist.h"
 
 #include <backend/webapi_objects/webapi_media_objects.h>
+#include <backend/webapi_objects/webapi_fields_filter.h>
 #include <utils/json_std_extenders.h>
 
 namespace sptf
 {
 
 SPTF_NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE( WebApi_Artist_Simplified, id, name );
+SPTF_DEFINE_FIELDS_FILTER( WebApi_Artist_Simplified, id, name );
 SPTF_NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE( WebApi_Artist, id, images, name, popularity );
 
 } // namespace sptf
@@ -29,6 +29,7 @@ struct WebApi_Artist
 
 void to_json( nlohmann::json& j, const WebApi_Artist_Simplified& p );
 void from_json( const nlohmann::json& j, WebApi_Artist_Simplified& p );
+std::string GetFieldsFilter( const WebApi_Artist_Simplified* );
 
 void to_json( nlohmann::json& j, const WebApi_Artist& p );
 void from_json( const nlohmann::json& j, WebApi_Artist& p );
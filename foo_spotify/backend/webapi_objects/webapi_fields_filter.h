@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Support for `fields` query parameter: only the fields that are actually deserialized are requested.
+// Filter for type `T` is provided by `std::string GetFieldsFilter( const T* )` overload.
+
+namespace sptf
+{
+
+namespace internal
+{
+
+template <typename T>
+struct UnwrapField
+{
+    using type = T;
+};
+
+template <typename T>
+struct UnwrapField<std::unique_ptr<T>> : UnwrapField<T>
+{
+};
+
+template <typename T>
+struct UnwrapField<std::shared_ptr<T>> : UnwrapField<T>
+{
+};
+
+template <typename T>
+struct UnwrapField<std::optional<T>> : UnwrapField<T>
+{
+};
+
+template <typename T>
+struct UnwrapField<std::vector<T>> : UnwrapField<T>
+{
+};
+
+template <typename T, typename = void>
+struct HasFieldsFilter : std::false_type
+{
+};
+
+template <typename T>
+struct HasFieldsFilter<T, std::void_t<decltype( GetFieldsFilter( static_cast<const T*>( nullptr ) ) )>> : std::true_type
+{
+};
+
+} // namespace internal
+
+/// @return `name` for plain fields and `name(subfield1,subfield2,...)` for objects
+template <typename T>
+std::string GetFieldFilter( std::string_view name )
+{
+    using U = std::remove_const_t<typename internal::UnwrapField<T>::type>;
+    if constexpr ( internal::HasFieldsFilter<U>::value )
+    {
+        return fmt::format( "{}({})", name, GetFieldsFilter( static_cast<const U*>( nullptr ) ) );
+    }
+    else
+    {
+        return std::string( name );
+    }
+}
+
+} // namespace sptf
+
+#define SPTF_FIELDS_FILTER_APPEND( v1 ) \
+    sptf_filters.emplace_back( ::sptf::GetFieldFilter<decltype( sptf_type::v1 )>( #v1 ) );
+
+/// Should be supplied with the same field list as `from_json`
+#define SPTF_DEFINE_FIELDS_FILTER( Type, ... )                                                \
+    std::string GetFieldsFilter( const Type* )                                                \
+    {                                                                                         \
+        using sptf_type = Type;                                                               \
+        std::vector<std::string> sptf_filters;                                                \
+        NLOHMANN_JSON_EXPAND( NLOHMANN_JSON_PASTE( SPTF_FIELDS_FILTER_APPEND, __VA_ARGS__ ) ) \
+        return fmt::format( "{}", fmt::join( sptf_filters, "," ) );                           \
+    }
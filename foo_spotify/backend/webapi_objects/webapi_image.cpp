@@ -2,9 +2,12 @@
 
 #include "webapi_image.h"
 
+#include <backend/webapi_objects/webapi_fields_filter.h>
+
 namespace sptf
 {
 
 SPTF_NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE( WebApi_Image, height, url, width );
+SPTF_DEFINE_FIELDS_FILTER( WebApi_Image, height, url, width );
 
 } // namespace sptf
@@ -15,5 +15,6 @@ struct WebApi_Image
 
 void to_json( nlohmann::json& j, const WebApi_Image& p );
 void from_json( const nlohmann::json& j, WebApi_Image& p );
+std::string GetFieldsFilter( const WebApi_Image* );
 
-} // namespace sptf
\ No newline at end of file
+} // namespace sptf
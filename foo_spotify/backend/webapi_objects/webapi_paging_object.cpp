@@ -12,4 +12,10 @@ void from_json( const nlohmann::json& nlohmann_json_j, WebApi_PagingObject& nloh
     NLOHMANN_JSON_EXPAND( NLOHMANN_JSON_PASTE( NLOHMANN_JSON_FROM, items, limit, next, offset, previous, total ) )
 }
 
+std::string GetFieldsFilter( const WebApi_PagingObject*, const std::string& itemsFilter )
+{
+    // `items` is parsed by the caller
+    return fmt::format( "items({}),limit,next,offset,previous,total", itemsFilter );
+}
+
 } // namespace sptf
@@ -19,5 +19,7 @@ struct WebApi_PagingObject
 };
 
 void from_json( const nlohmann::json& j, WebApi_PagingObject& p );
+/// @param itemsFilter filter for the elements of `items`
+std::string GetFieldsFilter( const WebApi_PagingObject*, const std::string& itemsFilter );
 
 } // namespace sptf
@@ -3,6 +3,7 @@
 #include "webapi_playlist_track.h"
 
 #include <backend/webapi_objects/webapi_media_objects.h>
+#include <backend/webapi_objects/webapi_fields_filter.h>
 #include <utils/json_std_extenders.h>
 
 namespace sptf
@@ -28,6 +29,14 @@ void from_json( const nlohmann::json& j, WebApi_PlaylistTrack& p )
     }
 }
 
+std::string GetFieldsFilter( const WebApi_PlaylistTrack* )
+{
+    // `track` is either `WebApi_Track` or `WebApi_LocalTrack`:
+    // the latter needs only `uri` in addition to the fields of the former
+    return fmt::format( "is_local,track({},uri)", GetFieldsFilter( static_cast<const WebApi_Track*>( nullptr ) ) );
+}
+
 SPTF_NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE( WebApi_LocalTrack, uri, name );
+SPTF_DEFINE_FIELDS_FILTER( WebApi_LocalTrack, uri, name );
 
 } // namespace sptf
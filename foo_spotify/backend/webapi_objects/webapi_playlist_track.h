@@ -24,8 +24,10 @@ struct WebApi_PlaylistTrack
 
 void to_json( nlohmann::json& j, const WebApi_PlaylistTrack& p );
 void from_json( const nlohmann::json& j, WebApi_PlaylistTrack& p );
+std::string GetFieldsFilter( const WebApi_PlaylistTrack* );
 
 void to_json( nlohmann::json& j, const WebApi_LocalTrack& p );
 void from_json( const nlohmann::json& j, WebApi_LocalTrack& p );
+std::string GetFieldsFilter( const WebApi_LocalTrack* );
 
 } // namespace sptf
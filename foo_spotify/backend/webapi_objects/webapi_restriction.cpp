@@ -2,9 +2,12 @@
 
 #include "webapi_restriction.h"
 
+#include <backend/webapi_objects/webapi_fields_filter.h>
+
 namespace sptf
 {
 
 SPTF_NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE( WebApi_Restriction, reason );
+SPTF_DEFINE_FIELDS_FILTER( WebApi_Restriction, reason );
 
 } // namespace sptf
@@ -13,5 +13,6 @@ struct WebApi_Restriction
 
 void to_json( nlohmann::json& j, const WebApi_Restriction& p );
 void from_json( const nlohmann::json& j, WebApi_Restriction& p );
+std::string GetFieldsFilter( const WebApi_Restriction* );
 
 } // namespace sptf
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "webapi_track.h"
 
 #include <backend/webapi_objects/webapi_media_objects.h>
+#include <backend/webapi_objects/webapi_fields_filter.h>
 #include <utils/json_std_extenders.h>
 
 namespace sptf
@@ -61,4 +62,6 @@ void from_json( const nlohmann::json& nlohmann_json_j, WebApi_Track& nlohmann_js
     }
 }
 
+SPTF_DEFINE_FIELDS_FILTER( WebApi_Track, album, artists, disc_number, duration_ms, name, preview_url, track_number, id, linked_from, restrictions );
+
 } // namespace sptf
@@ -63,5 +63,6 @@ void from_json( const nlohmann::json& j, WebApi_Track_Simplified& p );
 
 void to_json( nlohmann::json& j, const WebApi_Track& p );
 void from_json( const nlohmann::json& j, WebApi_Track& p );
+std::string GetFieldsFilter( const WebApi_Track* );
 
 } // namespace sptf
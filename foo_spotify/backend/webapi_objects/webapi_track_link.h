@@ -16,5 +16,6 @@ struct WebApi_TrackLink
 
 void to_json( nlohmann::json& j, const WebApi_TrackLink& p );
 void from_json( const nlohmann::json& j, WebApi_TrackLink& p );
+std::string GetFieldsFilter( const WebApi_TrackLink* );
 
 } // namespace sptf
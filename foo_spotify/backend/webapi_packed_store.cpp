@@ -0,0 +1,482 @@
+#include <stdafx.h>
+
+#include "webapi_packed_store.h"
+
+#include <qwr/file_helpers.h>
+#include <qwr/winapi_error_helpers.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+constexpr uint32_t kFileMagic = 0x46545053;   // "SPTF"
+constexpr uint32_t kRecordMagic = 0x52545053; // "SPTR"
+/// space that should be skipped: its size is stored in `valueSize`
+constexpr uint32_t kPaddingMagic = 0x50545053; // "SPTP"
+constexpr uint32_t kFileVersion = 1;
+
+/// compaction is not worth it for small files
+constexpr uint64_t kMinStaleSizeForCompaction = 1024 * 1024;
+/// size of the reads performed while scanning the file on open
+constexpr uint64_t kScanBlockSize = 1024 * 1024;
+
+#pragma pack( push )
+#pragma pack( 1 )
+struct FileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct RecordHeader
+{
+    uint32_t magic;
+    uint32_t keySize;
+    uint32_t valueSize;
+};
+#pragma pack( pop )
+
+template <typename T>
+void AppendBytes( std::vector<uint8_t>& data, const T& value )
+{
+    const auto pValue = reinterpret_cast<const uint8_t*>( &value );
+    data.insert( data.end(), pValue, pValue + sizeof( value ) );
+}
+
+std::vector<uint8_t> PackRecord( const std::string& key, const std::vector<uint8_t>& valueData )
+{
+    assert( key.size() <= std::numeric_limits<uint32_t>::max() );
+    assert( valueData.size() <= std::numeric_limits<uint32_t>::max() );
+
+    std::vector<uint8_t> record;
+    record.reserve( sizeof( RecordHeader ) + key.size() + valueData.size() );
+    AppendBytes( record, RecordHeader{ kRecordMagic, static_cast<uint32_t>( key.size() ), static_cast<uint32_t>( valueData.size() ) } );
+    record.insert( record.end(), key.cbegin(), key.cend() );
+    record.insert( record.end(), valueData.cbegin(), valueData.cend() );
+    return record;
+}
+
+} // namespace
+
+namespace sptf
+{
+
+WebApi_PackedStore::WebApi_PackedStore( const fs::path& filePath, const fs::path& legacyDir )
+    : filePath_( filePath )
+    , legacyDir_( legacyDir )
+{
+}
+
+WebApi_PackedStore::~WebApi_PackedStore()
+{
+}
+
+std::optional<nlohmann::json> WebApi_PackedStore::Get( const std::string& key, size_t* pDataSize )
+{
+    EnsureOpened();
+
+    const auto dataOpt = ReadValue( key );
+    if ( !dataOpt )
+    {
+        return std::nullopt;
+    }
+
+    if ( pDataSize )
+    {
+        *pDataSize = dataOpt->size();
+    }
+
+    try
+    {
+        return nlohmann::json::from_cbor( *dataOpt );
+    }
+    catch ( const nlohmann::detail::exception& )
+    {
+        return std::nullopt;
+    }
+}
+
+size_t WebApi_PackedStore::Put( const std::string& key, const nlohmann::json& value )
+{
+    const std::pair<std::string, nlohmann::json> keyValue{ key, value };
+    return Put( nonstd::span<const std::pair<std::string, nlohmann::json>>( &keyValue, 1 ) )[0];
+}
+
+std::vector<size_t> WebApi_PackedStore::Put( nonstd::span<const std::pair<std::string, nlohmann::json>> values )
+{
+    EnsureOpened();
+
+    std::vector<uint8_t> records;
+    // offset of the record relative to `records`
+    std::vector<uint64_t> recordOffsets;
+    std::vector<size_t> valueSizes;
+    recordOffsets.reserve( values.size() );
+    valueSizes.reserve( values.size() );
+
+    for ( const auto& [key, value]: values )
+    {
+        const auto valueData = nlohmann::json::to_cbor( value );
+        const auto record = PackRecord( key, valueData );
+
+        recordOffsets.emplace_back( records.size() );
+        valueSizes.emplace_back( valueData.size() );
+        records.insert( records.end(), record.cbegin(), record.cend() );
+    }
+
+    if ( records.empty() )
+    {
+        return valueSizes;
+    }
+
+    std::shared_lock fileLock( fileMutex_ );
+
+    const auto baseOffset = [&] {
+        std::unique_lock lock( mutex_ );
+        const auto offset = fileSize_;
+        fileSize_ += records.size();
+        return offset;
+    }();
+
+    // Space is reserved beforehand, so concurrent writes don't overlap.
+    try
+    {
+        Write( baseOffset, records );
+    }
+    catch ( ... )
+    { // reserved space is marked as padding, so that records after it are not dropped on the next open
+        assert( records.size() - sizeof( RecordHeader ) <= std::numeric_limits<uint32_t>::max() );
+        const RecordHeader padding{ kPaddingMagic, 0, static_cast<uint32_t>( records.size() - sizeof( RecordHeader ) ) };
+        try
+        {
+            Write( baseOffset, nonstd::span<const uint8_t>( reinterpret_cast<const uint8_t*>( &padding ), sizeof( padding ) ) );
+
+            std::unique_lock lock( mutex_ );
+            staleSize_ += records.size();
+        }
+        catch ( ... )
+        { // records after it will be dropped on the next open, same as after an interrupted write
+        }
+        throw;
+    }
+
+    std::unique_lock lock( mutex_ );
+    for ( size_t i = 0; i < values.size(); ++i )
+    {
+        AddToIndex_NonBlocking( values[i].first, baseOffset + recordOffsets[i], static_cast<uint32_t>( valueSizes[i] ) );
+    }
+
+    return valueSizes;
+}
+
+bool WebApi_PackedStore::Contains( const std::string& key )
+{
+    EnsureOpened();
+
+    std::shared_lock lock( mutex_ );
+    return index_.count( key );
+}
+
+std::vector<std::string> WebApi_PackedStore::GetMissingKeys( nonstd::span<const std::string> keys )
+{
+    EnsureOpened();
+
+    std::vector<std::string> missingKeys;
+
+    std::shared_lock lock( mutex_ );
+    std::copy_if( keys.begin(), keys.end(), std::back_inserter( missingKeys ), [&]( const auto& key ) { return !index_.count( key ); } );
+
+    return missingKeys;
+}
+
+void WebApi_PackedStore::EnsureOpened()
+{
+    {
+        std::shared_lock lock( mutex_ );
+        if ( isOpened_ )
+        {
+            return;
+        }
+    }
+
+    std::unique_lock fileLock( fileMutex_ );
+    std::unique_lock lock( mutex_ );
+    if ( isOpened_ )
+    {
+        return;
+    }
+
+    Open_NonBlocking();
+    ImportLegacyDir_NonBlocking();
+
+    if ( staleSize_ > kMinStaleSizeForCompaction && staleSize_ * 2 > fileSize_ )
+    {
+        Compact_NonBlocking();
+    }
+}
+
+void WebApi_PackedStore::Open_NonBlocking()
+{
+    assert( !isOpened_ );
+
+    fs::create_directories( filePath_.parent_path() );
+
+    const auto hFile = CreateFile( filePath_.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+    qwr::error::CheckWinApi( hFile != INVALID_HANDLE_VALUE, "CreateFile" );
+    hFile_.Attach( hFile );
+
+    LARGE_INTEGER fileSize{};
+    auto bRet = GetFileSizeEx( hFile_, &fileSize );
+    qwr::error::CheckWinApi( bRet, "GetFileSizeEx" );
+    fileSize_ = static_cast<uint64_t>( fileSize.QuadPart );
+
+    index_.clear();
+    staleSize_ = 0;
+
+    if ( const auto validSize = ScanRecords_NonBlocking();
+         validSize != fileSize_ )
+    { // either the file is from the incompatible version or the last write was interrupted
+        Truncate_NonBlocking( validSize );
+    }
+
+    if ( !fileSize_ )
+    {
+        const FileHeader fileHeader{ kFileMagic, kFileVersion };
+        Write( 0, nonstd::span<const uint8_t>( reinterpret_cast<const uint8_t*>( &fileHeader ), sizeof( fileHeader ) ) );
+        fileSize_ = sizeof( fileHeader );
+    }
+
+    isOpened_ = true;
+}
+
+void WebApi_PackedStore::Close_NonBlocking()
+{
+    hFile_.Close();
+
+    index_.clear();
+    fileSize_ = 0;
+    staleSize_ = 0;
+    isOpened_ = false;
+}
+
+void WebApi_PackedStore::Compact_NonBlocking()
+{
+    if ( !staleSize_ )
+    {
+        return;
+    }
+
+    // records are written in the original order to keep related objects close
+    std::vector<std::pair<const std::string*, Location>> records;
+    records.reserve( index_.size() );
+    for ( const auto& [key, location]: index_ )
+    {
+        records.emplace_back( &key, location );
+    }
+    std::sort( records.begin(), records.end(), []( const auto& a, const auto& b ) { return a.second.offset < b.second.offset; } );
+
+    auto tmpPath = filePath_;
+    tmpPath += ".tmp";
+    {
+        std::ofstream out( tmpPath, std::ios::binary | std::ios::trunc );
+
+        const FileHeader fileHeader{ kFileMagic, kFileVersion };
+        out.write( reinterpret_cast<const char*>( &fileHeader ), sizeof( fileHeader ) );
+        for ( const auto& [pKey, location]: records )
+        {
+            const RecordHeader header{ kRecordMagic, static_cast<uint32_t>( pKey->size() ), location.size };
+            out.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+            out.write( pKey->data(), pKey->size() );
+            const auto value = Read( location.offset, location.size );
+            out.write( reinterpret_cast<const char*>( value.data() ), value.size() );
+        }
+
+        qwr::QwrException::ExpectTrue( out.good(), "Failed to write `{}`", tmpPath.u8string() );
+    }
+
+    // rename is atomic: the file is either the old one or the compacted one even if interrupted
+    Close_NonBlocking();
+    fs::rename( tmpPath, filePath_ );
+    Open_NonBlocking();
+}
+
+std::optional<std::vector<uint8_t>> WebApi_PackedStore::ReadValue( const std::string& key )
+{
+    // file is not replaced while the lock is held
+    std::shared_lock fileLock( fileMutex_ );
+
+    const auto locationOpt = [&]() -> std::optional<Location> {
+        std::shared_lock lock( mutex_ );
+
+        const auto it = index_.find( key );
+        if ( it == index_.cend() )
+        {
+            return std::nullopt;
+        }
+        return it->second;
+    }();
+    if ( !locationOpt )
+    {
+        return std::nullopt;
+    }
+
+    // records from the index are always complete, so the value can be read outside of the lock
+    return Read( locationOpt->offset, locationOpt->size );
+}
+
+uint64_t WebApi_PackedStore::ScanRecords_NonBlocking()
+{
+    if ( fileSize_ < sizeof( FileHeader ) )
+    {
+        return 0;
+    }
+
+    FileHeader fileHeader;
+    std::memcpy( &fileHeader, Read( 0, sizeof( fileHeader ) ).data(), sizeof( fileHeader ) );
+    if ( fileHeader.magic != kFileMagic || fileHeader.version != kFileVersion )
+    { // it's just a cache: simpler to fetch the data again than to convert it
+        return 0;
+    }
+
+    // there might be hundreds of thousands of records, so the file is read in big blocks
+    std::vector<uint8_t> block;
+    uint64_t blockOffset = 0;
+    const auto getData = [&]( uint64_t offset, size_t size ) {
+        assert( offset + size <= fileSize_ );
+        if ( offset < blockOffset || offset + size > blockOffset + block.size() )
+        {
+            blockOffset = offset;
+            block = Read( offset, static_cast<size_t>( std::min<uint64_t>( fileSize_ - offset, std::max<uint64_t>( size, kScanBlockSize ) ) ) );
+        }
+        return block.data() + ( offset - blockOffset );
+    };
+
+    uint64_t pos = sizeof( FileHeader );
+    while ( pos + sizeof( RecordHeader ) <= fileSize_ )
+    {
+        RecordHeader header;
+        std::memcpy( &header, getData( pos, sizeof( header ) ), sizeof( header ) );
+
+        const auto recordSize = sizeof( RecordHeader ) + static_cast<uint64_t>( header.keySize ) + header.valueSize;
+        if ( ( header.magic != kRecordMagic && header.magic != kPaddingMagic ) || pos + recordSize > fileSize_ )
+        { // interrupted write
+            break;
+        }
+
+        if ( header.magic == kPaddingMagic )
+        { // failed write
+            staleSize_ += recordSize;
+            pos += recordSize;
+            continue;
+        }
+
+        const auto pKey = reinterpret_cast<const char*>( getData( pos + sizeof( RecordHeader ), header.keySize ) );
+        AddToIndex_NonBlocking( std::string( pKey, header.keySize ), pos, header.valueSize );
+
+        pos += recordSize;
+    }
+
+    return pos;
+}
+
+void WebApi_PackedStore::ImportLegacyDir_NonBlocking()
+{
+    if ( !fs::exists( legacyDir_ ) )
+    {
+        return;
+    }
+
+    for ( const auto& entry: fs::directory_iterator( legacyDir_ ) )
+    {
+        const auto& path = entry.path();
+        if ( !entry.is_regular_file() || path.extension() != ".json" )
+        {
+            continue;
+        }
+
+        const auto key = path.stem().u8string();
+        if ( index_.count( key ) )
+        { // previous import was interrupted
+            continue;
+        }
+
+        try
+        {
+            const auto valueData = nlohmann::json::to_cbor( nlohmann::json::parse( qwr::file::ReadFile( path, CP_UTF8, false ) ) );
+            const auto record = PackRecord( key, valueData );
+
+            Write( fileSize_, record );
+            AddToIndex_NonBlocking( key, fileSize_, static_cast<uint32_t>( valueData.size() ) );
+            fileSize_ += record.size();
+        }
+        catch ( const nlohmann::detail::exception& )
+        { // broken files are ignored on read anyway
+        }
+    }
+
+    fs::remove_all( legacyDir_ );
+}
+
+void WebApi_PackedStore::AddToIndex_NonBlocking( const std::string& key, uint64_t recordOffset, uint32_t valueSize )
+{
+    const Location location{ recordOffset + sizeof( RecordHeader ) + key.size(), valueSize };
+
+    // later records replace earlier ones
+    auto [it, isNew] = index_.try_emplace( key, location );
+    if ( !isNew )
+    {
+        staleSize_ += sizeof( RecordHeader ) + key.size() + it->second.size;
+        it->second = location;
+    }
+}
+
+void WebApi_PackedStore::Truncate_NonBlocking( uint64_t size )
+{
+    LARGE_INTEGER distance{};
+    distance.QuadPart = static_cast<LONGLONG>( size );
+    auto bRet = SetFilePointerEx( hFile_, distance, nullptr, FILE_BEGIN );
+    qwr::error::CheckWinApi( bRet, "SetFilePointerEx" );
+    bRet = SetEndOfFile( hFile_ );
+    qwr::error::CheckWinApi( bRet, "SetEndOfFile" );
+
+    fileSize_ = size;
+}
+
+std::vector<uint8_t> WebApi_PackedStore::Read( uint64_t offset, size_t size )
+{
+    // same as in `Write`: the read starts at the specified offset, the file pointer is not used
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>( offset );
+    overlapped.OffsetHigh = static_cast<DWORD>( offset >> 32 );
+
+    std::vector<uint8_t> data( size );
+    DWORD bytesRead = 0;
+    const auto bRet = ReadFile( hFile_, data.data(), static_cast<DWORD>( data.size() ), &bytesRead, &overlapped );
+    qwr::error::CheckWinApi( bRet, "ReadFile" );
+    qwr::QwrException::ExpectTrue( bytesRead == data.size(), "Failed to read `{}`: unexpected end of file", filePath_.u8string() );
+
+    return data;
+}
+
+void WebApi_PackedStore::Write( uint64_t offset, nonstd::span<const uint8_t> data )
+{
+    // for synchronous handles the write is still blocking, but it starts at the specified offset
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>( offset );
+    overlapped.OffsetHigh = static_cast<DWORD>( offset >> 32 );
+
+    DWORD bytesWritten = 0;
+    const auto bRet = WriteFile( hFile_, data.data(), static_cast<DWORD>( data.size() ), &bytesWritten, &overlapped );
+    qwr::error::CheckWinApi( bRet, "WriteFile" );
+    qwr::QwrException::ExpectTrue( bytesWritten == data.size(), "Failed to write `{}`: disk is full", filePath_.u8string() );
+}
+
+} // namespace sptf
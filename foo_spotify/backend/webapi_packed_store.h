@@ -0,0 +1,103 @@
+#pragma once
+
+#include <nonstd/span.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sptf
+{
+
+/// Key-value storage packed into a single append-only file.
+///
+/// File consists of a header followed by records: record header, key, value.
+/// Values are stored in CBOR format. Replaced values stay in the file until compaction, which is performed on open.
+/// Index is kept in memory and is rebuilt by scanning the file on open.
+/// Values are read at their offsets from the index: the file is never mapped,
+/// since it might be too big for a contiguous view in 32-bit address space.
+///
+/// Thread-safe: lookups are performed under a shared lock,
+/// file reads, writes and value (de)serialization are performed outside of the index lock.
+class WebApi_PackedStore
+{
+public:
+    /// File is opened on the first access.
+    ///
+    /// @param legacyDir directory with `<key>.json` files that should be imported on the first open,
+    ///                  it is removed after import
+    WebApi_PackedStore( const std::filesystem::path& filePath, const std::filesystem::path& legacyDir );
+    ~WebApi_PackedStore();
+
+    WebApi_PackedStore( const WebApi_PackedStore& ) = delete;
+    WebApi_PackedStore& operator=( const WebApi_PackedStore& ) = delete;
+
+    /// @param pDataSize size of the stored data
+    /// @return std::nullopt if value is missing or can't be parsed
+    std::optional<nlohmann::json> Get( const std::string& key, size_t* pDataSize = nullptr );
+    /// Replaces the existing value
+    ///
+    /// @return size of the stored data
+    size_t Put( const std::string& key, const nlohmann::json& value );
+    /// Same as `Put`, but all the records are written with a single write
+    ///
+    /// @return sizes of the stored data
+    std::vector<size_t> Put( nonstd::span<const std::pair<std::string, nlohmann::json>> values );
+    bool Contains( const std::string& key );
+    /// Checks all the keys under a single lock
+    ///
+    /// @return keys that are missing from the store
+    std::vector<std::string> GetMissingKeys( nonstd::span<const std::string> keys );
+
+private:
+    void EnsureOpened();
+    void Open_NonBlocking();
+    void Close_NonBlocking();
+    void Compact_NonBlocking();
+
+    /// @return stored data
+    std::optional<std::vector<uint8_t>> ReadValue( const std::string& key );
+
+    /// @return size of the valid data
+    uint64_t ScanRecords_NonBlocking();
+    void ImportLegacyDir_NonBlocking();
+
+    void AddToIndex_NonBlocking( const std::string& key, uint64_t recordOffset, uint32_t valueSize );
+
+    void Truncate_NonBlocking( uint64_t size );
+    /// Reads at the specified offset without touching the file pointer, so it's safe to call concurrently
+    std::vector<uint8_t> Read( uint64_t offset, size_t size );
+    /// Writes at the specified offset without touching the file pointer, so it's safe to call concurrently
+    void Write( uint64_t offset, nonstd::span<const uint8_t> data );
+
+private:
+    struct Location
+    {
+        /// offset of the value
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    const std::filesystem::path filePath_;
+    const std::filesystem::path legacyDir_;
+
+    /// guards the file itself: shared by writes, exclusive for operations that replace the file
+    std::shared_mutex fileMutex_;
+    /// guards everything below
+    std::shared_mutex mutex_;
+
+    bool isOpened_ = false;
+    CHandle hFile_;
+    /// includes space reserved by pending writes
+    uint64_t fileSize_ = 0;
+    /// size of the replaced records and padding
+    uint64_t staleSize_ = 0;
+
+    std::unordered_map<std::string, Location> index_;
+};
+
+} // namespace sptf
@@ -0,0 +1,191 @@
+#include <stdafx.h>
+
+#include "webapi_request_batcher.h"
+
+#include <utils/abort_manager.h>
+
+namespace sptf
+{
+
+WebApi_RequestBatcher::WebApi_RequestBatcher( AbortManager& abortManager, BatchProcessor processBatch, size_t maxBatchSize, std::chrono::milliseconds window )
+    : abortManager_( abortManager )
+    , processBatch_( processBatch )
+    , maxBatchSize_( maxBatchSize )
+    , window_( window )
+{
+    assert( maxBatchSize_ );
+}
+
+void WebApi_RequestBatcher::Finalize()
+{
+    std::vector<std::shared_ptr<Batch>> batches;
+    {
+        std::lock_guard lock( mutex_ );
+        batches.assign( activeBatches_.cbegin(), activeBatches_.cend() );
+        pPendingBatch_.reset();
+
+        for ( auto& pBatch: batches )
+        {
+            if ( !pBatch->isStarted )
+            { // waiters must not start it anymore
+                pBatch->isStarted = true;
+                CompleteBatch_NonBlocking( *pBatch, std::make_exception_ptr( qwr::QwrException( "Abort was signaled, canceling request..." ) ) );
+                activeBatches_.erase( pBatch );
+            }
+        }
+    }
+
+    // cancellation might trigger continuations, which should not be executed under lock
+    for ( auto& pBatch: batches )
+    {
+        pBatch->cts.cancel();
+    }
+    for ( auto& pBatch: batches )
+    {
+        pplx::create_task( pBatch->doneEvent ).wait();
+    }
+}
+
+bool WebApi_RequestBatcher::IsEnabled() const
+{
+    return ( window_.count() > 0 );
+}
+
+void WebApi_RequestBatcher::Process( const std::string& id, abort_callback& abort )
+{
+    auto pBatch = [&] {
+        std::unique_lock lock( mutex_ );
+
+        if ( !pPendingBatch_ )
+        {
+            pPendingBatch_ = std::make_shared<Batch>();
+            pPendingBatch_->deadline = std::chrono::steady_clock::now() + window_;
+            activeBatches_.emplace( pPendingBatch_ );
+        }
+
+        auto pBatch = pPendingBatch_;
+        if ( pBatch->uniqueIds.emplace( id ).second )
+        {
+            pBatch->ids.emplace_back( id );
+        }
+        ++pBatch->waiterCount;
+
+        if ( pBatch->ids.size() >= maxBatchSize_ )
+        { // no point in waiting for the window to expire
+            StartBatch( lock, pBatch );
+        }
+
+        return pBatch;
+    }();
+
+    const auto abortableScope = abortManager_.GetAbortableScope( [&] {
+        {
+            std::lock_guard lock( mutex_ );
+        }
+        pBatch->cv.notify_all();
+    },
+                                                                 abort );
+
+    std::unique_lock lock( mutex_ );
+    while ( !pBatch->isDone && !abort.is_aborting() )
+    {
+        if ( pBatch->isStarted )
+        {
+            pBatch->cv.wait( lock );
+        }
+        else if ( std::chrono::steady_clock::now() < pBatch->deadline )
+        {
+            pBatch->cv.wait_until( lock, pBatch->deadline );
+        }
+        else
+        { // the first waiter to notice that the window has expired starts the batch
+            StartBatch( lock, pBatch );
+        }
+    }
+
+    --pBatch->waiterCount;
+    if ( !pBatch->isDone )
+    {
+        if ( !pBatch->waiterCount )
+        { // nobody needs the result anymore
+            if ( pPendingBatch_ == pBatch )
+            { // new callers must not join the aborted batch
+                pPendingBatch_.reset();
+            }
+
+            if ( pBatch->isStarted )
+            {
+                lock.unlock();
+                pBatch->cts.cancel();
+            }
+            else
+            { // nothing was requested yet
+                pBatch->isStarted = true;
+                CompleteBatch_NonBlocking( *pBatch, std::make_exception_ptr( qwr::QwrException( "Abort was signaled, canceling request..." ) ) );
+                activeBatches_.erase( pBatch );
+            }
+        }
+        throw qwr::QwrException( "Abort was signaled, canceling request..." );
+    }
+
+    if ( pBatch->pError )
+    {
+        std::rethrow_exception( pBatch->pError );
+    }
+}
+
+void WebApi_RequestBatcher::StartBatch( std::unique_lock<std::mutex>& lock, std::shared_ptr<Batch> pBatch )
+{
+    assert( !pBatch->isStarted );
+    pBatch->isStarted = true;
+    if ( pPendingBatch_ == pBatch )
+    { // no more ids can be added after this point
+        pPendingBatch_.reset();
+    }
+
+    // `ids` is not modified after the start, so it can be accessed without lock;
+    // processor might invoke continuations, which should not be executed under lock
+    lock.unlock();
+
+    auto onDone = [this, pBatch]( std::exception_ptr pError ) {
+        std::lock_guard lock( mutex_ );
+        CompleteBatch_NonBlocking( *pBatch, pError );
+        activeBatches_.erase( pBatch );
+    };
+
+    try
+    {
+        processBatch_( pBatch->ids, pBatch->cts.get_token() )
+            .then( [onDone]( pplx::task<void> task ) {
+                try
+                {
+                    task.get();
+                    onDone( nullptr );
+                }
+                catch ( const pplx::task_canceled& )
+                {
+                    onDone( std::make_exception_ptr( qwr::QwrException( "Abort was signaled, canceling request..." ) ) );
+                }
+                catch ( ... )
+                {
+                    onDone( std::current_exception() );
+                }
+            } );
+    }
+    catch ( ... )
+    {
+        onDone( std::current_exception() );
+    }
+
+    lock.lock();
+}
+
+void WebApi_RequestBatcher::CompleteBatch_NonBlocking( Batch& batch, std::exception_ptr pError )
+{
+    batch.pError = pError;
+    batch.isDone = true;
+    batch.cv.notify_all();
+    batch.doneEvent.set();
+}
+
+} // namespace sptf
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <nonstd/span.hpp>
+#include <pplx/pplxtasks.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace sptf
+{
+
+class AbortManager;
+
+/// Collects ids from single-item requests for a short period of time,
+/// so that they can be processed with a single batch request.
+///
+/// No thread is blocked for the duration of the window: the batch is started by one of its waiters
+/// (which are blocked anyway) and is processed asynchronously.
+class WebApi_RequestBatcher
+{
+public:
+    /// @param ids unique ids, no more than `maxBatchSize`
+    /// @param token canceled when there are no waiters left
+    using BatchProcessor = std::function<pplx::task<void>( nonstd::span<const std::string> ids, pplx::cancellation_token token )>;
+
+    WebApi_RequestBatcher( AbortManager& abortManager, BatchProcessor processBatch, size_t maxBatchSize, std::chrono::milliseconds window );
+    ~WebApi_RequestBatcher() = default;
+
+    void Finalize();
+
+    bool IsEnabled() const;
+
+    /// Blocks until the batch containing `id` is processed.
+    ///
+    /// @throw qwr::QwrException on abort
+    /// @throw std::exception on batch processing failure
+    void Process( const std::string& id, abort_callback& abort );
+
+private:
+    struct Batch
+    {
+        std::chrono::steady_clock::time_point deadline;
+        std::vector<std::string> ids;
+        std::unordered_set<std::string> uniqueIds;
+        size_t waiterCount = 0;
+        bool isStarted = false;
+        bool isDone = false;
+        std::exception_ptr pError;
+        pplx::cancellation_token_source cts;
+        /// set when the batch is done, regardless of the result
+        pplx::task_completion_event<void> doneEvent;
+        std::condition_variable cv;
+    };
+
+    /// Should be called under `mutex_`, lock is released while the batch is being started
+    void StartBatch( std::unique_lock<std::mutex>& lock, std::shared_ptr<Batch> pBatch );
+    /// Should be called under `mutex_`
+    void CompleteBatch_NonBlocking( Batch& batch, std::exception_ptr pError );
+
+private:
+    AbortManager& abortManager_;
+    const BatchProcessor processBatch_;
+    const size_t maxBatchSize_;
+    const std::chrono::milliseconds window_;
+
+    std::mutex mutex_;
+    std::shared_ptr<Batch> pPendingBatch_;
+    std::unordered_set<std::shared_ptr<Batch>> activeBatches_;
+};
+
+} // namespace sptf
@@ -5,11 +5,25 @@ namespace sptf::guid
 
 constexpr GUID acfu_source = { 0xbfbd48bc, 0x9f3b, 0x42bd, { 0x8e, 0xfc, 0x9d, 0x5a, 0xf1, 0x2f, 0xf3, 0xa1 } };
 constexpr GUID adv_branch = { 0x3e2d241a, 0x306b, 0x49bc, { 0x80, 0xb3, 0x6a, 0x77, 0xe9, 0x21, 0x32, 0xc7 } };
+constexpr GUID adv_branch_cache = { 0xc8f1e368, 0x7c74, 0x422b, { 0x93, 0xc0, 0xed, 0xc2, 0x35, 0x43, 0x68, 0xce } };
 constexpr GUID adv_branch_logging = { 0xa69190a1, 0x3abd, 0x4a45, { 0x9c, 0x4a, 0x66, 0xbd, 0xb, 0x7f, 0xec, 0x11 } };
 constexpr GUID adv_branch_network = { 0x53328c11, 0x156e, 0x4b5c, { 0x8f, 0x82, 0xe5, 0x3d, 0x5d, 0xb5, 0x7c, 0x2b } };
+constexpr GUID adv_branch_playback = { 0x9965b34f, 0xef41, 0x482d, { 0x86, 0xb9, 0xfa, 0xd2, 0x6c, 0x50, 0xd6, 0xe } };
+constexpr GUID adv_var_cache_memory_limit = { 0xd9e19046, 0xbfec, 0x4ac1, { 0x9d, 0x8, 0xd9, 0x48, 0x12, 0x31, 0x53, 0xa3 } };
+constexpr GUID adv_var_network_batch_window = { 0xd201756, 0x4c28, 0x49e1, { 0x95, 0x25, 0x88, 0x16, 0x4a, 0xd9, 0x84, 0x26 } };
+constexpr GUID adv_var_network_compression = { 0x876cb22e, 0x29e3, 0x49c1, { 0xba, 0xca, 0x17, 0x58, 0x8c, 0x24, 0xd, 0xbe } };
+constexpr GUID adv_var_network_keep_alive = { 0x3ec517e, 0xed0e, 0x4cb1, { 0xb6, 0x73, 0x2e, 0x5d, 0x2a, 0xcb, 0x68, 0xbd } };
+constexpr GUID adv_var_network_timeout = { 0xc0bc59aa, 0x380e, 0x4435, { 0x8c, 0x59, 0xc6, 0xc1, 0x93, 0xeb, 0xc9, 0x83 } };
+constexpr GUID adv_var_network_chunk_size = { 0x55bb86a9, 0xc44a, 0x4c81, { 0x88, 0x3a, 0x9d, 0xe0, 0xf, 0x1b, 0x54, 0x46 } };
 constexpr GUID adv_var_network_proxy = { 0x2626706b, 0x19a9, 0x4ccf, { 0x85, 0xdd, 0x55, 0xd4, 0x2f, 0x8b, 0x57, 0x46 } };
 constexpr GUID adv_var_network_proxy_username = { 0xd9e86980, 0xcee4, 0x4075, { 0x96, 0xef, 0x79, 0xed, 0xba, 0x87, 0x79, 0x58 } };
 constexpr GUID adv_var_network_proxy_password = { 0xd138fb5, 0x3e6f, 0x48d6, { 0x9b, 0x44, 0x44, 0x6c, 0x78, 0xd4, 0x6f, 0xa3 } };
+constexpr GUID adv_var_playback_chunk_duration = { 0x67a9aa20, 0xb9e9, 0x40dc, { 0xa2, 0x8c, 0xb7, 0xd6, 0x9, 0x8, 0xd3, 0x89 } };
+constexpr GUID adv_var_playback_adaptive_event_loop = { 0xe0b5fd56, 0x7d68, 0x41f8, { 0xbc, 0x35, 0xf, 0xcb, 0x65, 0x41, 0x24, 0x2a } };
+constexpr GUID adv_var_playback_prefetch_lead = { 0xcf1cc19d, 0xb9dc, 0x4276, { 0xbf, 0x5f, 0xbb, 0xd0, 0xc1, 0x11, 0x91, 0xd0 } };
+constexpr GUID adv_var_playback_normalization_preamp = { 0xf7380479, 0xbc01, 0x44ba, { 0xbe, 0x9a, 0x14, 0x41, 0x76, 0xc8, 0xf0, 0x78 } };
+constexpr GUID adv_var_logging_libspotify_stats = { 0x2ef5ef35, 0x7200, 0x4158, { 0xaf, 0xba, 0x5b, 0x57, 0xd9, 0x9b, 0x79, 0x8d } };
+constexpr GUID adv_var_logging_playback_stats = { 0xb3d16cad, 0xb0d6, 0x4125, { 0x89, 0x77, 0x46, 0x4a, 0x32, 0x4c, 0xe8, 0xe5 } };
 constexpr GUID adv_var_logging_webapi_debug = { 0xea784339, 0x21d7, 0x47ab, { 0xbc, 0xeb, 0x7a, 0xf7, 0xc, 0x8f, 0xb0, 0x18 } };
 constexpr GUID adv_var_logging_webapi_request = { 0x90066d1d, 0x1233, 0x4fcc, { 0xab, 0xc3, 0xbc, 0x17, 0xb4, 0x68, 0x65, 0x84 } };
 constexpr GUID adv_var_logging_webapi_response = { 0x349d3d49, 0xfffc, 0x4b32, { 0x8b, 0xf7, 0xc0, 0x78, 0x3a, 0x87, 0x5e, 0xa4 } };
@@ -11,6 +11,10 @@ advconfig_branch_factory branch_network(
     "Network: restart is required", sptf::guid::adv_branch_network, sptf::guid::adv_branch, 0 );
 advconfig_branch_factory branch_logging(
     "Logging: restart is required", sptf::guid::adv_branch_logging, sptf::guid::adv_branch, 1 );
+advconfig_branch_factory branch_playback(
+    "Playback: restart is required", sptf::guid::adv_branch_playback, sptf::guid::adv_branch, 2 );
+advconfig_branch_factory branch_cache(
+    "Cache: restart is required", sptf::guid::adv_branch_cache, sptf::guid::adv_branch, 3 );
 
 } // namespace
 
@@ -32,6 +36,56 @@ qwr::fb2k::AdvConfigString_MT network_proxy_password(
     sptf::guid::adv_var_network_proxy_password, sptf::guid::adv_branch_network, 2,
     "" );
 
+qwr::fb2k::AdvConfigUInt32_MT network_batch_window(
+    "Merge single track and artist requests made within this period (in ms, 0 - disabled)",
+    sptf::guid::adv_var_network_batch_window, sptf::guid::adv_branch_network, 3,
+    10, 0, 1000 );
+
+qwr::fb2k::AdvConfigBool_MT network_compression(
+    "Request compressed responses",
+    sptf::guid::adv_var_network_compression, sptf::guid::adv_branch_network, 4,
+    true );
+
+qwr::fb2k::AdvConfigBool_MT network_keep_alive(
+    "Reuse connections between requests",
+    sptf::guid::adv_var_network_keep_alive, sptf::guid::adv_branch_network, 5,
+    true );
+
+qwr::fb2k::AdvConfigUInt32_MT network_timeout(
+    "Request timeout (in seconds)",
+    sptf::guid::adv_var_network_timeout, sptf::guid::adv_branch_network, 6,
+    30, 1, 600 );
+
+qwr::fb2k::AdvConfigUInt32_MT network_chunk_size(
+    "Response read buffer size (in KB)",
+    sptf::guid::adv_var_network_chunk_size, sptf::guid::adv_branch_network, 7,
+    64, 4, 1024 );
+
+qwr::fb2k::AdvConfigUInt32_MT playback_chunk_duration(
+    "Merge audio data into chunks of this duration (in ms, 0 - disabled)",
+    sptf::guid::adv_var_playback_chunk_duration, sptf::guid::adv_branch_playback, 0,
+    100, 0, 1000 );
+
+qwr::fb2k::AdvConfigUInt32_MT playback_prefetch_lead(
+    "Prefetch next track this many seconds before the end of the current one (0 - disabled)",
+    sptf::guid::adv_var_playback_prefetch_lead, sptf::guid::adv_branch_playback, 1,
+    10, 0, 60 );
+
+qwr::fb2k::AdvConfigBool_MT playback_adaptive_event_loop(
+    "Give priority to playback controls over libspotify event processing",
+    sptf::guid::adv_var_playback_adaptive_event_loop, sptf::guid::adv_branch_playback, 2,
+    true );
+
+qwr::fb2k::AdvConfigUInt32_MT playback_normalization_preamp(
+    "Amplify normalized audio by this much (in dB, used only when volume normalization is enabled)",
+    sptf::guid::adv_var_playback_normalization_preamp, sptf::guid::adv_branch_playback, 3,
+    0, 0, 12 );
+
+qwr::fb2k::AdvConfigUInt32_MT cache_memory_limit(
+    "Keep this much of recently used track and artist metadata in memory (in MB, per metadata type, 0 - disabled)",
+    sptf::guid::adv_var_cache_memory_limit, sptf::guid::adv_branch_cache, 0,
+    16, 0, 1024 );
+
 qwr::fb2k::AdvConfigBool_MT logging_webapi_request(
     "Log Spotify Web API: request",
     sptf::guid::adv_var_logging_webapi_request, sptf::guid::adv_branch_logging, 0,
@@ -47,4 +101,14 @@ qwr::fb2k::AdvConfigBool_MT logging_webapi_debug(
     sptf::guid::adv_var_logging_webapi_debug, sptf::guid::adv_branch_logging, 2,
     false );
 
+qwr::fb2k::AdvConfigBool_MT logging_playback_stats(
+    "Log playback statistics",
+    sptf::guid::adv_var_logging_playback_stats, sptf::guid::adv_branch_logging, 3,
+    false );
+
+qwr::fb2k::AdvConfigBool_MT logging_libspotify_stats(
+    "Log libspotify event loop statistics",
+    sptf::guid::adv_var_logging_libspotify_stats, sptf::guid::adv_branch_logging, 4,
+    false );
+
 } // namespace sptf::config::advanced
@@ -8,9 +8,23 @@ namespace sptf::config::advanced
 extern qwr::fb2k::AdvConfigString_MT network_proxy;
 extern qwr::fb2k::AdvConfigString_MT network_proxy_username;
 extern qwr::fb2k::AdvConfigString_MT network_proxy_password;
+extern qwr::fb2k::AdvConfigUInt32_MT network_batch_window;
+extern qwr::fb2k::AdvConfigBool_MT network_compression;
+extern qwr::fb2k::AdvConfigBool_MT network_keep_alive;
+extern qwr::fb2k::AdvConfigUInt32_MT network_timeout;
+extern qwr::fb2k::AdvConfigUInt32_MT network_chunk_size;
+
+extern qwr::fb2k::AdvConfigUInt32_MT playback_chunk_duration;
+extern qwr::fb2k::AdvConfigUInt32_MT playback_prefetch_lead;
+extern qwr::fb2k::AdvConfigBool_MT playback_adaptive_event_loop;
+extern qwr::fb2k::AdvConfigUInt32_MT playback_normalization_preamp;
+
+extern qwr::fb2k::AdvConfigUInt32_MT cache_memory_limit;
 
 extern qwr::fb2k::AdvConfigBool_MT logging_webapi_request;
 extern qwr::fb2k::AdvConfigBool_MT logging_webapi_response;
 extern qwr::fb2k::AdvConfigBool_MT logging_webapi_debug;
+extern qwr::fb2k::AdvConfigBool_MT logging_playback_stats;
+extern qwr::fb2k::AdvConfigBool_MT logging_libspotify_stats;
 
 } // namespace sptf::config::advanced
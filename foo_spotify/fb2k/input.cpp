@@ -6,11 +6,14 @@
 #include <backend/spotify_object.h>
 #include <backend/webapi_backend.h>
 #include <backend/webapi_objects/webapi_media_objects.h>
+#include <fb2k/advanced_config.h>
 #include <fb2k/config.h>
 #include <fb2k/file_info_filler.h>
+#include <utils/pcm_converter.h>
 
 #include <qwr/string_helpers.h>
 
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <fstream>
@@ -20,6 +23,8 @@
 using namespace std::literals::string_view_literals;
 using namespace sptf;
 
+static_assert( std::is_same_v<audio_sample, float>, "PCM converter supports only 32-bit float samples" );
+
 namespace
 {
 
@@ -103,6 +108,7 @@ private:
     std::unordered_multimap<std::string, std::string> trackMeta_;
 
     bool isFirstBlock_ = false;
+    float gain_ = 1.0f;
     int channels_{};
     int sampleRate_{};
     int bitRate_{};
@@ -149,6 +155,61 @@ std::string GetPlaybackErrorMessage( sp_error sp, const std::string& trackId, ab
     return sp_error_message( sp );
 }
 
+/// @return gain on top of volume normalization, which is performed by libspotify itself
+float GetOutputGain()
+{
+    if ( !config::enable_normalization )
+    {
+        return 1.0f;
+    }
+
+    const auto preampInDb = config::advanced::playback_normalization_preamp.GetValue();
+    return static_cast<float>( std::pow( 10.0, preampInDb / 20.0 ) );
+}
+
+template <typename Limits, typename Counts>
+void LogHistogram( const char* name, const Limits& limits, const Counts& counts )
+{
+    std::vector<std::string> buckets;
+    for ( size_t i = 0; i < limits.size(); ++i )
+    {
+        buckets.emplace_back( fmt::format( "<{}ms: {}", limits[i], counts[i] ) );
+    }
+    buckets.emplace_back( fmt::format( ">={}ms: {}", limits.back(), counts.back() ) );
+
+    FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (debug): " << name << ":\n"
+                             << fmt::format( "{}", fmt::join( buckets, ", " ) );
+}
+
+void LogPlaybackStats( const AudioBuffer& buf )
+{
+    LogHistogram( "audio chunk durations", AudioBuffer::ChunkStats::k_bucketLimitsInMs, buf.get_chunk_stats().counts );
+    LogHistogram( "seek to first sample latency", AudioBuffer::SeekStats::k_bucketLimitsInMs, buf.get_seek_stats().counts );
+}
+
+void LogEventLoopStats( const LibSpotify_Backend::EventLoopStats& stats )
+{
+    FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (debug): libspotify event loop:\n"
+                             << fmt::format( "wakeups: notify - {}, timeout - {}; yields to API calls: {}\n"
+                                             "process_events: count - {}, total - {}us, max - {}us",
+                                             stats.notifyWakeups,
+                                             stats.timeoutWakeups,
+                                             stats.yields,
+                                             stats.processEventsCount,
+                                             stats.processEventsTotalUs,
+                                             stats.processEventsMaxUs );
+
+    for ( const auto& lockWait: stats.lockWaits )
+    {
+        FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (debug): libspotify lock wait:\n"
+                                 << fmt::format( "{}: count - {}, total - {}us, max - {}us",
+                                                 lockWait.caller,
+                                                 lockWait.count,
+                                                 lockWait.totalWaitUs,
+                                                 lockWait.maxWaitUs );
+    }
+}
+
 } // namespace
 
 namespace
@@ -183,7 +244,7 @@ void InputSpotify::Finalize()
 
     if ( track_ )
     {
-        lsBackend.ExecSpMutex( [&] {
+        lsBackend.ExecSpMutex( "input: release track", [&] {
             track_.Release();
         } );
     }
@@ -205,7 +266,7 @@ void InputSpotify::open( service_ptr_t<file> m_file, const char* p_path, t_input
     const auto spotifyObject = SpotifyFilteredTrack::Parse( p_path );
     trackId_ = spotifyObject.Id();
     const auto track = waBackend.GetTrack( trackId_, p_abort );
-    trackMeta_ = waBackend.GetMetaForTracks( nonstd::span<const std::unique_ptr<const WebApi_Track>>( &track, 1 ) )[0];
+    trackMeta_ = waBackend.GetMetaForTracks( nonstd::span<const std::shared_ptr<const WebApi_Track>>( &track, 1 ) )[0];
 
     if ( p_reason == input_open_info_read )
     { // don't use LibSpotify stuff if it's not needed
@@ -216,7 +277,7 @@ void InputSpotify::open( service_ptr_t<file> m_file, const char* p_path, t_input
 
     auto pSession = lsBackend.GetInitializedSpSession( p_abort );
 
-    lsBackend.ExecSpMutex( [&] {
+    lsBackend.ExecSpMutex( "input: open", [&] {
         wrapper::Ptr<sp_link> link( sp_link_create_from_string( spotifyObject.ToUri().c_str() ) );
         if ( !link )
         {
@@ -239,31 +300,10 @@ void InputSpotify::open( service_ptr_t<file> m_file, const char* p_path, t_input
         }
     } );
 
-    while ( true )
+    const auto sp = lsBackend.WaitForTrackLoad( track_, p_abort );
+    if ( sp != SP_ERROR_OK )
     {
-        // TODO: clean up here
-        const auto done = lsBackend.ExecSpMutex( [&] {
-            const auto sp = sp_track_error( track_ );
-            if ( SP_ERROR_OK == sp )
-            {
-                return true;
-            }
-            else if ( SP_ERROR_IS_LOADING == sp )
-            {
-                return false;
-            }
-            else
-            {
-                throw qwr::QwrException( fmt::format( "sp_track_error failed: {}", sp_error_message( sp ) ) );
-            }
-        } );
-
-        if ( done )
-        {
-            break;
-        }
-
-        p_abort.sleep( 0.05 );
+        throw qwr::QwrException( fmt::format( "sp_track_error failed: {}", sp_error_message( sp ) ) );
     }
 
     bitRate_ = [] {
@@ -301,7 +341,7 @@ void InputSpotify::get_info( t_int32 subsong, file_info& p_info, abort_callback&
     if ( openedReason_ == input_open_decode )
     { // Use exact length when possible
         auto& lsBackend = GetInitializedLibSpotify();
-        lsBackend.ExecSpMutex( [&] {
+        lsBackend.ExecSpMutex( "input: get length", [&] {
             p_info.set_length( sp_track_duration( track_ ) / 1000.0 );
         } );
     }
@@ -315,6 +355,7 @@ foobar2000_io::t_filestats InputSpotify::get_file_stats( abort_callback& p_abort
 void InputSpotify::decode_initialize( t_int32 subsong, unsigned p_flags, abort_callback& p_abort )
 {
     isFirstBlock_ = true;
+    gain_ = GetOutputGain();
 
     if ( subsong )
     {
@@ -330,10 +371,12 @@ void InputSpotify::decode_initialize( t_int32 subsong, unsigned p_flags, abort_c
     lsBackend.AcquireDecoder( this );
     hasDecoder_ = true;
 
-    lsBackend.GetAudioBuffer().clear();
+    // anything left from the previous track is discarded
+    lsBackend.GetAudioBuffer().reset_stats();
+    lsBackend.GetAudioBuffer().begin_track();
     auto pSession = lsBackend.GetInitializedSpSession( p_abort );
 
-    lsBackend.ExecSpMutex( [&] {
+    lsBackend.ExecSpMutex( "input: player load", [&] {
         const auto sp = sp_session_player_load( pSession, track_ );
         if ( sp != SP_ERROR_OK )
         {
@@ -348,20 +391,25 @@ bool InputSpotify::decode_run( audio_chunk& p_chunk, abort_callback& p_abort )
 {
     bool isEof = false;
     const auto dataReader = [&]( const AudioBuffer::AudioChunkHeader& header,
-                                 const uint16_t* data ) {
-        if ( header.eof )
+                                 nonstd::span<const int16_t> first,
+                                 nonstd::span<const int16_t> second ) {
+        if ( header.is_eof() )
         {
             isEof = true;
             return;
         }
         channels_ = header.channels;
         sampleRate_ = header.sampleRate;
-        p_chunk.set_data_fixedpoint( data,
-                                     header.size * sizeof( uint16_t ),
-                                     header.sampleRate,
-                                     header.channels,
-                                     16,
-                                     audio_chunk::channel_config_stereo );
+
+        // convert straight from the ring buffer into chunk storage
+        p_chunk.set_data_size( header.size );
+        auto pOut = p_chunk.get_data();
+        pcm::ConvertInt16ToFloat( first.data(), first.size(), pOut, gain_ );
+        pcm::ConvertInt16ToFloat( second.data(), second.size(), pOut + first.size(), gain_ );
+
+        p_chunk.set_sample_count( header.size / header.channels );
+        p_chunk.set_srate( header.sampleRate );
+        p_chunk.set_channels( header.channels, audio_chunk::g_guess_channel_config( header.channels ) );
     };
 
     auto& lsBackend = GetInitializedLibSpotify();
@@ -378,6 +426,15 @@ bool InputSpotify::decode_run( audio_chunk& p_chunk, abort_callback& p_abort )
 
     if ( isEof )
     {
+        if ( config::advanced::logging_playback_stats )
+        {
+            LogPlaybackStats( buf );
+        }
+        if ( config::advanced::logging_libspotify_stats )
+        {
+            LogEventLoopStats( lsBackend.GetEventLoopStats() );
+        }
+
         lsBackend.ReleaseDecoder( this );
         hasDecoder_ = false;
         return false;
@@ -390,11 +447,17 @@ void InputSpotify::decode_seek( double p_seconds, abort_callback& p_abort )
 {
     isFirstBlock_ = true;
 
+    const auto positionMs = static_cast<int>( p_seconds * 1000 );
+
     auto& lsBackend = GetInitializedLibSpotify();
-    lsBackend.GetAudioBuffer().clear(); // TODO: remove?
     auto pSession = lsBackend.GetInitializedSpSession( p_abort );
-    lsBackend.ExecSpMutex( [&] {
-        sp_session_player_seek( pSession, static_cast<int>( p_seconds * 1000 ) );
+    lsBackend.ExecSpMutex( "input: seek", [&] {
+        auto& audioBuffer = lsBackend.GetAudioBuffer();
+        // chunks that were delivered before the seek are skipped on read,
+        // and those that are delivered while it's being processed are dropped
+        audioBuffer.begin_seek();
+        sp_session_player_seek( pSession, positionMs );
+        audioBuffer.end_seek();
     } );
 }
 
@@ -3,12 +3,69 @@
 #include "playback.h"
 
 #include <backend/libspotify_backend.h>
+#include <backend/spotify_object.h>
+#include <fb2k/advanced_config.h>
+
+#include <qwr/thread_pool.h>
+
+namespace
+{
+
+/// @return nullptr, if the next track can't be predicted
+metadb_handle_ptr GetNextTrack()
+{
+    if ( playback_control::get()->get_stop_after_current() )
+    {
+        return nullptr;
+    }
+
+    auto pm = playlist_manager::get();
+
+    pfc::list_t<t_playback_queue_item> queue;
+    pm->queue_get_contents( queue );
+    if ( queue.get_count() )
+    {
+        return queue[0].m_handle;
+    }
+
+    // only the default order is deterministic
+    if ( pm->playback_order_get_active() != 0 )
+    {
+        return nullptr;
+    }
+
+    t_size playlistIdx;
+    t_size itemIdx;
+    if ( !pm->get_playing_item_location( &playlistIdx, &itemIdx )
+         || itemIdx + 1 >= pm->playlist_get_item_count( playlistIdx ) )
+    {
+        return nullptr;
+    }
+
+    metadb_handle_ptr pNextTrack;
+    if ( !pm->playlist_get_item_handle( pNextTrack, playlistIdx, itemIdx + 1 ) )
+    {
+        return nullptr;
+    }
+
+    return pNextTrack;
+}
+
+} // namespace
 
 namespace sptf::fb2k
 {
 
 std::mutex PlayCallbacks::mutex_;
 LibSpotify_Backend* PlayCallbacks::pLsBackend_ = nullptr;
+qwr::ThreadPool* PlayCallbacks::pThreadPool_ = nullptr;
+double PlayCallbacks::trackLength_ = 0;
+size_t PlayCallbacks::generation_ = 0;
+bool PlayCallbacks::isPrefetchDone_ = false;
+bool PlayCallbacks::isPrefetchQueued_ = false;
+std::mutex PlayCallbacks::prefetchMutex_;
+std::string PlayCallbacks::prefetchedUri_;
+wrapper::Ptr<sp_track> PlayCallbacks::prefetchedTrack_;
 
 PlayCallbacks::PlayCallbacks()
 {
@@ -18,21 +75,30 @@ PlayCallbacks::~PlayCallbacks()
 {
 }
 
-void PlayCallbacks::Initialize( LibSpotify_Backend& lsBackend )
+void PlayCallbacks::Initialize( LibSpotify_Backend& lsBackend, qwr::ThreadPool& threadPool )
 {
     std::lock_guard lg( mutex_ );
     pLsBackend_ = &lsBackend;
+    pThreadPool_ = &threadPool;
 }
 
 void PlayCallbacks::Finalize()
 {
+    // waits for the prefetch in progress
+    std::lock_guard prefetchLock( prefetchMutex_ );
     std::lock_guard lg( mutex_ );
+
+    if ( pLsBackend_ )
+    {
+        ReleasePrefetchedTrack_NonBlocking( *pLsBackend_ );
+    }
     pLsBackend_ = nullptr;
+    pThreadPool_ = nullptr;
 }
 
 unsigned PlayCallbacks::get_flags()
 {
-    return ( flag_on_playback_stop | flag_on_playback_pause );
+    return ( flag_on_playback_stop | flag_on_playback_pause | flag_on_playback_new_track | flag_on_playback_time );
 }
 
 void PlayCallbacks::on_playback_pause( bool isPaused )
@@ -45,7 +111,7 @@ void PlayCallbacks::on_playback_pause( bool isPaused )
     }
 
     auto pSession = pLsBackend_->GetWhateverSpSession();
-    pLsBackend_->ExecSpMutex( [&] {
+    pLsBackend_->ExecSpMutex( "playback: pause", [&] {
         sp_session_player_play( pSession, !isPaused );
     } );
 }
@@ -59,17 +125,141 @@ void PlayCallbacks::on_playback_stop( play_control::t_stop_reason reason )
 
     std::lock_guard lg( mutex_ );
 
+    ++generation_;
+    isPrefetchDone_ = false;
+
     if ( !pLsBackend_ )
     {
         return;
     }
 
     auto pSession = pLsBackend_->GetWhateverSpSession();
-    pLsBackend_->ExecSpMutex( [&] {
+    pLsBackend_->ExecSpMutex( "playback: stop", [&] {
         sp_session_player_unload( pSession );
     } );
 }
 
+void PlayCallbacks::on_playback_new_track( metadb_handle_ptr p_track )
+{
+    std::lock_guard lg( mutex_ );
+
+    trackLength_ = p_track->get_length();
+    ++generation_;
+    // previously prefetched track is released by the next prefetch
+    isPrefetchDone_ = false;
+}
+
+void PlayCallbacks::on_playback_time( double p_time )
+{
+    std::lock_guard lg( mutex_ );
+
+    if ( !pLsBackend_ )
+    {
+        return;
+    }
+
+    const uint32_t prefetchLead = config::advanced::playback_prefetch_lead;
+    if ( !prefetchLead || isPrefetchDone_ || isPrefetchQueued_ || trackLength_ <= 0 || trackLength_ - p_time > prefetchLead )
+    {
+        return;
+    }
+
+    // playlist can be accessed only from the main thread
+    const auto pNextTrack = GetNextTrack();
+    if ( !pNextTrack || !SpotifyFilteredTrack::IsValid( pNextTrack->get_path(), false ) )
+    { // nothing to prefetch
+        isPrefetchDone_ = true;
+        return;
+    }
+
+    // libspotify lock might be busy for a while, so it's not acquired on the main thread
+    isPrefetchQueued_ = true;
+    pThreadPool_->AddTask( [uri = SpotifyFilteredTrack::Parse( pNextTrack->get_path() ).ToUri(), generation = generation_] {
+        PrefetchTrack( uri, generation );
+    } );
+}
+
+void PlayCallbacks::PrefetchTrack( const std::string& uri, size_t generation )
+{
+    std::lock_guard prefetchLock( prefetchMutex_ );
+
+    auto pLsBackend = [&]() -> LibSpotify_Backend* {
+        std::lock_guard lg( mutex_ );
+        return ( generation == generation_ ? pLsBackend_ : nullptr );
+    }();
+
+    bool isDone = true;
+    if ( pLsBackend )
+    {
+        try
+        {
+            isDone = PrefetchTrack_NonBlocking( *pLsBackend, uri );
+        }
+        catch ( const std::exception& e )
+        {
+            FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (error):\n"
+                                     << "Failed to prefetch track:\n"
+                                     << e.what();
+        }
+    }
+
+    std::lock_guard lg( mutex_ );
+    isPrefetchQueued_ = false;
+    if ( generation == generation_ )
+    {
+        isPrefetchDone_ = isDone;
+    }
+}
+
+bool PlayCallbacks::PrefetchTrack_NonBlocking( LibSpotify_Backend& lsBackend, const std::string& uri )
+{
+    if ( prefetchedUri_ != uri )
+    {
+        ReleasePrefetchedTrack_NonBlocking( lsBackend );
+
+        lsBackend.ExecSpMutex( "playback: prefetch lookup", [&] {
+            wrapper::Ptr<sp_link> link( sp_link_create_from_string( uri.c_str() ) );
+            if ( link && sp_link_type( link ) == SP_LINKTYPE_TRACK )
+            {
+                // starts loading of the track metadata
+                prefetchedTrack_ = sp_link_as_track( link );
+            }
+        } );
+        prefetchedUri_ = uri;
+    }
+
+    if ( !prefetchedTrack_ )
+    {
+        return true;
+    }
+
+    auto pSession = lsBackend.GetWhateverSpSession();
+    return lsBackend.ExecSpMutex( "playback: prefetch", [&] {
+        if ( sp_track_error( prefetchedTrack_ ) == SP_ERROR_IS_LOADING )
+        { // `on_playback_time` is called every second, so we'll retry soon
+            return false;
+        }
+
+        // audio data is cached by libspotify, so there is nothing to do on failure:
+        // the track will be loaded as usual when it starts playing
+        (void)sp_session_player_prefetch( pSession, prefetchedTrack_ );
+        return true;
+    } );
+}
+
+void PlayCallbacks::ReleasePrefetchedTrack_NonBlocking( LibSpotify_Backend& lsBackend )
+{
+    prefetchedUri_.clear();
+    if ( !prefetchedTrack_ )
+    {
+        return;
+    }
+
+    lsBackend.ExecSpMutex( "playback: release prefetched track", [&] {
+        prefetchedTrack_.Release();
+    } );
+}
+
 } // namespace sptf::fb2k
 
 namespace
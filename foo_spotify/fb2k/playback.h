@@ -1,6 +1,14 @@
 #pragma once
 
+#include <backend/libspotify_wrapper.h>
+
 #include <mutex>
+#include <string>
+
+namespace qwr
+{
+class ThreadPool;
+}
 
 namespace sptf
 {
@@ -19,26 +27,47 @@ public:
     PlayCallbacks();
     ~PlayCallbacks();
 
-    static void Initialize( LibSpotify_Backend& lsBackend );
+    static void Initialize( LibSpotify_Backend& lsBackend, qwr::ThreadPool& threadPool );
     static void Finalize();
 
     // play_callback_static
     unsigned get_flags() override;
     void on_playback_pause( bool isPaused ) override;
     void on_playback_stop( play_control::t_stop_reason reason ) override;
+    void on_playback_new_track( metadb_handle_ptr p_track ) override;
+    void on_playback_time( double p_time ) override;
 
     void on_playback_starting( play_control::t_track_command p_command, bool p_paused ) override{};
-    void on_playback_new_track( metadb_handle_ptr p_track ) override{};
     void on_playback_seek( double p_time ) override{};
     void on_playback_edited( metadb_handle_ptr p_track ) override{};
     void on_playback_dynamic_info( const file_info& p_info ) override{};
     void on_playback_dynamic_info_track( const file_info& p_info ) override{};
-    void on_playback_time( double p_time ) override{};
     void on_volume_change( float p_new_val ) override{};
 
+private:
+    /// Called on a worker thread
+    static void PrefetchTrack( const std::string& uri, size_t generation );
+    /// @return true, if there is no need to retry
+    static bool PrefetchTrack_NonBlocking( LibSpotify_Backend& lsBackend, const std::string& uri );
+    static void ReleasePrefetchedTrack_NonBlocking( LibSpotify_Backend& lsBackend );
+
 private:
     static std::mutex mutex_;
     static LibSpotify_Backend* pLsBackend_;
+    static qwr::ThreadPool* pThreadPool_;
+
+    // prefetch state: guarded by `mutex_`
+    static double trackLength_;
+    /// incremented on every track change, so that the results of outdated prefetches are ignored
+    static size_t generation_;
+    static bool isPrefetchDone_;
+    static bool isPrefetchQueued_;
+
+    /// held by the worker for the whole prefetch: keeps `pLsBackend_` alive until `Finalize`
+    static std::mutex prefetchMutex_;
+    // prefetched track: guarded by `prefetchMutex_`
+    static std::string prefetchedUri_;
+    static wrapper::Ptr<sp_track> prefetchedTrack_;
 };
 
 } // namespace sptf::fb2k
@@ -9,6 +9,8 @@
 #include <qwr/error_popup.h>
 #include <qwr/string_helpers.h>
 
+#include <functional>
+
 using namespace std::literals::string_view_literals;
 
 using namespace sptf;
@@ -106,8 +108,12 @@ TransformToSkippedTracks( nonstd::span<const std::unique_ptr<const WebApi_LocalT
            | ranges::to_vector;
 }
 
-std::tuple<std::vector<std::unique_ptr<const sptf::WebApi_Track>>, std::vector<SkippedTrack>>
-GetTracks( const SpotifyObject spotifyObject, abort_callback& p_abort )
+using TracksProcessor = std::function<void( nonstd::span<const std::shared_ptr<const WebApi_Track>> tracks )>;
+
+/// @param processTracks might be called multiple times: tracks are passed as soon as they are received
+/// @return tracks that can't be added
+std::vector<SkippedTrack>
+ProcessTracks( const SpotifyObject spotifyObject, const TracksProcessor& processTracks, abort_callback& p_abort )
 {
     auto& waBackend = SpotifyInstance::Get().GetWebApi_Backend();
 
@@ -122,36 +128,48 @@ GetTracks( const SpotifyObject spotifyObject, abort_callback& p_abort )
 
     if ( spotifyObject.type == "album" )
     {
-        auto tracks = waBackend.GetTracksFromAlbum( spotifyObject.id, p_abort );
+        const auto tracks = waBackend.GetTracksFromAlbum( spotifyObject.id, p_abort );
         preCacheArtists( tracks, p_abort );
+        processTracks( tracks );
 
-        return { std::move( tracks ), std::vector<SkippedTrack>{} };
+        return {};
     }
     else if ( spotifyObject.type == "playlist" )
     {
-        auto [tracks, localTracks] = waBackend.GetTracksFromPlaylist( spotifyObject.id, p_abort );
-        preCacheArtists( tracks, p_abort );
-
-        // ??? Dunno why this is required. Smth to do with structured bindings and RVO.
-        return { std::move( tracks ), TransformToSkippedTracks( localTracks ) };
+        std::vector<SkippedTrack> skippedTracks;
+        waBackend.GetTracksFromPlaylist(
+            spotifyObject.id,
+            [&]( auto tracks, auto localTracks ) {
+                preCacheArtists( tracks, p_abort );
+                processTracks( tracks );
+
+                auto newSkippedTracks = TransformToSkippedTracks( localTracks );
+                skippedTracks.insert( skippedTracks.end(), make_move_iterator( newSkippedTracks.begin() ), make_move_iterator( newSkippedTracks.end() ) );
+            },
+            p_abort );
+
+        return skippedTracks;
     }
     else if ( spotifyObject.type == "artist" )
     {
-        return { waBackend.GetTopTracksForArtist( spotifyObject.id, p_abort ), std::vector<SkippedTrack>{} };
+        processTracks( waBackend.GetTopTracksForArtist( spotifyObject.id, p_abort ) );
+
+        return {};
     }
     else if ( spotifyObject.type == "track" )
     {
-        std::vector<std::unique_ptr<const WebApi_Track>> tmp;
+        std::vector<std::shared_ptr<const WebApi_Track>> tmp;
         tmp.emplace_back( waBackend.GetTrack( spotifyObject.id, p_abort ) );
+        processTracks( tmp );
 
-        return { std::move( tmp ), std::vector<SkippedTrack>{} };
+        return {};
     }
     else if ( spotifyObject.type == "local" )
     {
         std::vector<SkippedTrack> tmp;
         tmp.emplace_back( SkippedTrack{ spotifyObject.id, "local track" } );
 
-        return { std::vector<std::unique_ptr<const sptf::WebApi_Track>>{}, tmp };
+        return tmp;
     }
     else
     {
@@ -200,19 +218,22 @@ void PlaylistLoaderSpotify::open( const char* p_path, const service_ptr_t<file>&
 
     auto& waBackend = SpotifyInstance::Get().GetWebApi_Backend();
 
-    auto [tracks, skippedTracks] = GetTracks( spotifyObject, p_abort );
-    std::vector<std::string> relinkedTracks;
-
-    const auto tracksMeta = waBackend.GetMetaForTracks( tracks );
-    for ( const auto& [track, trackMeta]: ranges::views::zip( tracks, tracksMeta ) )
-    {
-        file_info_impl f_info;
-        sptf::fb2k::FillFileInfoWithMeta( trackMeta, f_info );
-
-        metadb_handle_ptr f_handle;
-        p_callback->handle_create( f_handle, make_playable_location( SpotifyFilteredTrack( track->id ).ToSchema().c_str(), 0 ) );
-        p_callback->on_entry_info( f_handle, playlist_loader_callback::entry_user_requested, filestats_invalid, f_info, false );
-    }
+    const auto skippedTracks = ProcessTracks(
+        spotifyObject,
+        [&]( auto tracks ) {
+            // entries are added right away, so that huge playlists don't have to be kept in memory
+            const auto tracksMeta = waBackend.GetMetaForTracks( tracks );
+            for ( const auto& [track, trackMeta]: ranges::views::zip( tracks, tracksMeta ) )
+            {
+                file_info_impl f_info;
+                sptf::fb2k::FillFileInfoWithMeta( trackMeta, f_info );
+
+                metadb_handle_ptr f_handle;
+                p_callback->handle_create( f_handle, make_playable_location( SpotifyFilteredTrack( track->id ).ToSchema().c_str(), 0 ) );
+                p_callback->on_entry_info( f_handle, playlist_loader_callback::entry_user_requested, filestats_invalid, f_info, false );
+            }
+        },
+        p_abort );
 
     ReportSkippedTracks( skippedTracks );
 }
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cassert>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace sptf
+{
+
+/// Least-recently-used cache with a limit on the total size of the stored values.
+/// Not thread-safe.
+template <typename Key, typename Value>
+class LruCache
+{
+public:
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t itemCount = 0;
+        size_t sizeInBytes = 0;
+    };
+
+    /// @param maxSizeInBytes 0 - cache is disabled
+    LruCache( size_t maxSizeInBytes )
+        : maxSizeInBytes_( maxSizeInBytes )
+    {
+    }
+
+    ~LruCache() = default;
+
+    /// Marks the item as recently used
+    std::optional<Value> Get( const Key& key )
+    {
+        const auto it = index_.find( key );
+        if ( it == index_.end() )
+        {
+            ++stats_.misses;
+            return std::nullopt;
+        }
+
+        ++stats_.hits;
+        items_.splice( items_.begin(), items_, it->second );
+        return it->second->value;
+    }
+
+    /// Does not affect the item order and stats
+    bool Contains( const Key& key ) const
+    {
+        return index_.count( key );
+    }
+
+    /// Replaces the existing item.
+    /// Items that are bigger than the cache itself are not stored.
+    ///
+    /// @param sizeInBytes approximate size of the value
+    void Put( const Key& key, Value value, size_t sizeInBytes )
+    {
+        Erase( key );
+
+        if ( sizeInBytes > maxSizeInBytes_ )
+        {
+            return;
+        }
+
+        while ( stats_.sizeInBytes + sizeInBytes > maxSizeInBytes_ )
+        {
+            assert( !items_.empty() );
+            Erase( items_.back().key );
+        }
+
+        items_.push_front( Item{ key, std::move( value ), sizeInBytes } );
+        index_.emplace( key, items_.begin() );
+        stats_.sizeInBytes += sizeInBytes;
+        ++stats_.itemCount;
+    }
+
+    void Erase( const Key& key )
+    {
+        const auto it = index_.find( key );
+        if ( it == index_.end() )
+        {
+            return;
+        }
+
+        const auto itemIt = it->second;
+        stats_.sizeInBytes -= itemIt->sizeInBytes;
+        --stats_.itemCount;
+
+        index_.erase( it );
+        items_.erase( itemIt );
+    }
+
+    const Stats& GetStats() const
+    {
+        return stats_;
+    }
+
+private:
+    struct Item
+    {
+        Key key;
+        Value value;
+        size_t sizeInBytes;
+    };
+
+    const size_t maxSizeInBytes_;
+    Stats stats_;
+
+    /// most recently used first
+    std::list<Item> items_;
+    std::unordered_map<Key, typename std::list<Item>::iterator> index_;
+};
+
+} // namespace sptf
@@ -0,0 +1,117 @@
+#include <stdafx.h>
+
+#include "pcm_converter.h"
+
+#include <intrin.h>
+
+namespace
+{
+
+constexpr float kInt16Scale = 1.0f / 32768.0f;
+
+using ConverterFn = void ( * )( const int16_t*, size_t, float*, float );
+
+void ConvertInt16ToFloat_Scalar( const int16_t* pIn, size_t count, float* pOut, float gain )
+{
+    const float scale = gain * kInt16Scale;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        pOut[i] = static_cast<float>( pIn[i] ) * scale;
+    }
+}
+
+void ConvertInt16ToFloat_Sse2( const int16_t* pIn, size_t count, float* pOut, float gain )
+{
+    const __m128 scale = _mm_set1_ps( gain * kInt16Scale );
+
+    size_t i = 0;
+    for ( ; i + 8 <= count; i += 8 )
+    {
+        const __m128i in = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pIn + i ) );
+        // sign-extend by placing int16 in the upper half and shifting it back
+        const __m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( in, in ), 16 );
+        const __m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( in, in ), 16 );
+        _mm_storeu_ps( pOut + i, _mm_mul_ps( _mm_cvtepi32_ps( lo ), scale ) );
+        _mm_storeu_ps( pOut + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( hi ), scale ) );
+    }
+
+    ConvertInt16ToFloat_Scalar( pIn + i, count - i, pOut + i, gain );
+}
+
+void ConvertInt16ToFloat_Avx2( const int16_t* pIn, size_t count, float* pOut, float gain )
+{
+    const __m256 scale = _mm256_set1_ps( gain * kInt16Scale );
+
+    size_t i = 0;
+    for ( ; i + 16 <= count; i += 16 )
+    {
+        const __m256i lo = _mm256_cvtepi16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>( pIn + i ) ) );
+        const __m256i hi = _mm256_cvtepi16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>( pIn + i + 8 ) ) );
+        _mm256_storeu_ps( pOut + i, _mm256_mul_ps( _mm256_cvtepi32_ps( lo ), scale ) );
+        _mm256_storeu_ps( pOut + i + 8, _mm256_mul_ps( _mm256_cvtepi32_ps( hi ), scale ) );
+    }
+    // avoid AVX-SSE transition penalty in the tail code
+    _mm256_zeroupper();
+
+    ConvertInt16ToFloat_Sse2( pIn + i, count - i, pOut + i, gain );
+}
+
+bool HasSse2()
+{
+    int cpuInfo[4]{};
+    __cpuid( cpuInfo, 1 );
+    return !!( cpuInfo[3] & ( 1 << 26 ) );
+}
+
+bool HasAvx2()
+{
+    int cpuInfo[4]{};
+    __cpuid( cpuInfo, 0 );
+    if ( cpuInfo[0] < 7 )
+    {
+        return false;
+    }
+
+    __cpuid( cpuInfo, 1 );
+    const bool hasOsxsave = !!( cpuInfo[2] & ( 1 << 27 ) );
+    const bool hasAvx = !!( cpuInfo[2] & ( 1 << 28 ) );
+    if ( !hasOsxsave || !hasAvx )
+    {
+        return false;
+    }
+
+    // OS must preserve YMM registers
+    if ( ( _xgetbv( 0 ) & 0x6 ) != 0x6 )
+    {
+        return false;
+    }
+
+    __cpuidex( cpuInfo, 7, 0 );
+    return !!( cpuInfo[1] & ( 1 << 5 ) );
+}
+
+ConverterFn SelectConverter()
+{
+    if ( HasAvx2() )
+    {
+        return &ConvertInt16ToFloat_Avx2;
+    }
+    if ( HasSse2() )
+    {
+        return &ConvertInt16ToFloat_Sse2;
+    }
+    return &ConvertInt16ToFloat_Scalar;
+}
+
+} // namespace
+
+namespace sptf::pcm
+{
+
+void ConvertInt16ToFloat( const int16_t* pIn, size_t count, float* pOut, float gain )
+{
+    static const ConverterFn converter = SelectConverter();
+    converter( pIn, count, pOut, gain );
+}
+
+} // namespace sptf::pcm
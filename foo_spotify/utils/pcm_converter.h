@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sptf::pcm
+{
+
+/// Converts interleaved 16-bit PCM to float samples in [-1.0; 1.0), applying `gain` in the same pass.
+/// Channel layout is irrelevant, since both input and output are interleaved.
+///
+/// Uses AVX2 or SSE2 when available (detected on first call), scalar code otherwise.
+void ConvertInt16ToFloat( const int16_t* pIn, size_t count, float* pOut, float gain );
+
+} // namespace sptf::pcm
@@ -1,94 +1,224 @@
-
 #include <stdafx.h>
 
 #include "rps_limiter.h"
 
-#include <backend/spotify_instance.h>
-#include <fb2k/advanced_config.h>
 #include <utils/abort_manager.h>
-#include <utils/sleeper.h>
 
 #include <qwr/final_action.h>
 
+#include <algorithm>
+
 namespace
 {
 
-std::chrono::milliseconds GetTimestampInMs()
-{
-    return std::chrono::time_point_cast<std::chrono::milliseconds>( std::chrono::system_clock::now() ).time_since_epoch();
-}
+/// background request is served regardless of interactive ones after waiting for this long
+constexpr auto kMaxBackgroundWait = std::chrono::seconds( 5 );
+/// at least one background request is served after this many interactive ones
+constexpr size_t kMaxInteractiveGrantsInRow = 4;
+
+constexpr double kMinTokensPerSecond = 0.1;
+/// rate is increased by approximately this value every second, when requests are sent at full rate
+constexpr double kAdditiveRateIncrease = 0.5;
+constexpr double kMultiplicativeRateDecrease = 0.5;
 
 } // namespace
 
 namespace sptf
 {
 
-RpsLimiter::RpsLimiter( size_t limitPerSecond, std::chrono::seconds limitPeriod )
-    : shouldLogWebApiDebug_( config::advanced::logging_webapi_debug )
-    , limitPeriod_( limitPeriod )
-    , timeStampsContainer_( limitPerSecond, GetTimestampInMs() - 2 * limitPeriod )
-    , timeStamps_( timeStampsContainer_.begin(), timeStampsContainer_.end(), timeStampsContainer_.begin(), timeStampsContainer_.size() )
+RpsLimiterClock RpsLimiterClock::Steady()
+{
+    return RpsLimiterClock{
+        [] { return std::chrono::steady_clock::now(); },
+        []( std::condition_variable& cv, std::unique_lock<std::mutex>& lock, time_point deadline ) {
+            cv.wait_until( lock, deadline );
+        }
+    };
+}
+
+RpsLimiter::RpsLimiter( AbortManager& abortManager,
+                        size_t limitPerSecond,
+                        size_t maxLimitPerSecond,
+                        size_t burstLimit,
+                        bool shouldLogDebug,
+                        RpsLimiterClock clock )
+    : abortManager_( abortManager )
+    , clock_( std::move( clock ) )
+    , shouldLogDebug_( shouldLogDebug )
+    , maxTokensPerSecond_( static_cast<double>( std::max( limitPerSecond, maxLimitPerSecond ) ) )
+    , maxTokens_( static_cast<double>( std::max<size_t>( burstLimit, 1 ) ) )
+    , tokensPerSecond_( static_cast<double>( limitPerSecond ) )
+    , tokens_( maxTokens_ )
+    , lastRefillTime_( clock_.now() )
 {
+    assert( limitPerSecond );
 }
 
-void RpsLimiter::WaitForRequestAvailability( abort_callback& abort )
+void RpsLimiter::WaitForRequestAvailability( RequestPriority priority, abort_callback& abort )
 {
     if ( abort.is_aborting() )
     {
         return;
     }
 
-    std::atomic_bool timeToDie = false;
-    auto& am = SpotifyInstance::Get().GetAbortManager();
-    const auto abortableScope = am.GetAbortableScope( [&] {
-        timeToDie = true;
+    const auto abortableScope = abortManager_.GetAbortableScope( [&] {
+        {
+            std::lock_guard lock( mutex_ );
+        }
         cv_.notify_all();
     },
-                                                      abort );
+                                                                 abort );
 
     std::unique_lock lock( mutex_ );
 
-    const auto nowInMs = GetTimestampInMs();
-    auto nextAvailableTime = timeStamps_.front() + limitPeriod_;
-    if ( nowInMs >= nextAvailableTime )
+    const auto now = clock_.now();
+    RefillTokens( now );
+    if ( tokens_ >= 1 && interactiveQueue_.empty() && backgroundQueue_.empty() )
     {
-        timeStamps_.emplace_back( nowInMs );
+        tokens_ -= 1;
         return;
     }
 
-    auto waitTime = nextAvailableTime - nowInMs;
-
-    const auto requestIdx = curRequestIdx_++;
-    incomingRequests_.emplace_back( requestIdx );
-    const auto curIt = std::prev( incomingRequests_.end() );
-    const qwr::final_action autoEraseRequest( [&] {
-        incomingRequests_.erase( curIt );
+    Waiter waiter{ now };
+    auto& queue = ( priority == RequestPriority::interactive ? interactiveQueue_ : backgroundQueue_ );
+    queue.emplace_back( &waiter );
+    const qwr::final_action autoEraseWaiter( [&] {
+        if ( !waiter.isGranted )
+        {
+            queue.erase( std::find( queue.begin(), queue.end(), &waiter ) );
+        }
     } );
 
     while ( true )
     {
-        if ( shouldLogWebApiDebug_ )
+        ProcessQueue( clock_.now() );
+        if ( waiter.isGranted || abort.is_aborting() )
+        {
+            return;
+        }
+
+        const auto nextTokenTime = GetNextTokenTime();
+        if ( shouldLogDebug_ )
         {
             FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (debug):\n"
-                                     << fmt::format( "throttling for {} milliseconds", waitTime.count() );
+                                     << fmt::format( "throttling for {} milliseconds",
+                                                     std::chrono::duration_cast<std::chrono::milliseconds>( nextTokenTime - clock_.now() ).count() );
         }
 
-        bool hasEvent = cv_.wait_for( lock, waitTime, [&] {
-            return timeToDie || ( incomingRequests_.front() == requestIdx && GetTimestampInMs() >= nextAvailableTime );
-        } );
+        while ( !waiter.isGranted && !abort.is_aborting() && clock_.now() < nextTokenTime )
+        {
+            clock_.waitUntil( cv_, lock, nextTokenTime );
+        }
+    }
+}
 
-        if ( hasEvent )
+void RpsLimiter::OnResponse( uint16_t statusCode )
+{
+    if ( statusCode < 200 || statusCode >= 300 )
+    {
+        return;
+    }
+
+    std::lock_guard lock( mutex_ );
+    // one request per `1 / tokensPerSecond_` seconds at full rate, so the increase is linear in time
+    tokensPerSecond_ = std::min( maxTokensPerSecond_, tokensPerSecond_ + kAdditiveRateIncrease / tokensPerSecond_ );
+}
+
+void RpsLimiter::OnRateLimited( std::chrono::milliseconds retryAfter )
+{
+    std::lock_guard lock( mutex_ );
+
+    const auto now = clock_.now();
+    RefillTokens( now );
+
+    const auto pauseEnd = now + retryAfter;
+    if ( pauseEnd > lastRefillTime_ )
+    { // tokens are not refilled until `lastRefillTime_`, which pauses all requests:
+        // queued waiters will see it when their current wait expires
+        lastRefillTime_ = pauseEnd;
+        // concurrent requests that were sent before the pause might report the same limit,
+        // so decrease rate only once per pause
+        tokensPerSecond_ = std::max( kMinTokensPerSecond, tokensPerSecond_ * kMultiplicativeRateDecrease );
+    }
+    tokens_ = 0;
+
+    if ( shouldLogDebug_ )
+    {
+        FB2K_console_formatter() << SPTF_UNDERSCORE_NAME " (debug):\n"
+                                 << fmt::format( "rate limit reached: pausing requests for {} milliseconds, new rate is {:.2f} requests per second",
+                                                 retryAfter.count(),
+                                                 tokensPerSecond_ );
+    }
+}
+
+void RpsLimiter::RefillTokens( TimePoint now )
+{
+    if ( now <= lastRefillTime_ )
+    {
+        return;
+    }
+
+    const auto elapsed = std::chrono::duration<double>( now - lastRefillTime_ ).count();
+    tokens_ = std::min( maxTokens_, tokens_ + elapsed * tokensPerSecond_ );
+    lastRefillTime_ = now;
+}
+
+void RpsLimiter::ProcessQueue( TimePoint now )
+{
+    RefillTokens( now );
+
+    bool hasGranted = false;
+    while ( tokens_ >= 1 )
+    {
+        auto pQueue = SelectQueue( now );
+        if ( !pQueue )
         {
-            if ( !timeToDie )
-            {
-                timeStamps_.emplace_back( GetTimestampInMs() );
-            }
-            return;
+            break;
         }
 
-        nextAvailableTime = GetTimestampInMs() + limitPeriod_;
-        waitTime = limitPeriod_;
+        auto pWaiter = pQueue->front();
+        pQueue->pop_front();
+        pWaiter->isGranted = true;
+        tokens_ -= 1;
+        hasGranted = true;
+
+        if ( pQueue == &interactiveQueue_ )
+        {
+            ++interactiveGrantsInRow_;
+        }
+        else
+        {
+            interactiveGrantsInRow_ = 0;
+        }
+    }
+
+    if ( hasGranted )
+    {
+        cv_.notify_all();
+    }
+}
+
+std::deque<RpsLimiter::Waiter*>* RpsLimiter::SelectQueue( TimePoint now )
+{
+    if ( interactiveQueue_.empty() )
+    {
+        return ( backgroundQueue_.empty() ? nullptr : &backgroundQueue_ );
+    }
+    if ( backgroundQueue_.empty() )
+    {
+        return &interactiveQueue_;
     }
+
+    // starvation protection
+    const bool isBackgroundStarving = ( interactiveGrantsInRow_ >= kMaxInteractiveGrantsInRow
+                                        || now - backgroundQueue_.front()->enqueueTime >= kMaxBackgroundWait );
+    return ( isBackgroundStarving ? &backgroundQueue_ : &interactiveQueue_ );
+}
+
+RpsLimiter::TimePoint RpsLimiter::GetNextTokenTime() const
+{
+    const auto missingTokens = std::max( 0.0, 1 - tokens_ );
+    return lastRefillTime_ + std::chrono::duration_cast<TimePoint::duration>( std::chrono::duration<double>( missingTokens / tokensPerSecond_ ) );
 }
 
 } // namespace sptf
@@ -1,40 +1,101 @@
 #pragma once
 
-#include <nonstd/ring_span.hpp>
-
 #include <chrono>
-#include <list>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <mutex>
-#include <vector>
 
 namespace sptf
 {
 
+class AbortManager;
+
+enum class RequestPriority
+{
+    /// user is waiting for the result (e.g. track is being opened for playback)
+    interactive,
+    /// cache refreshes, playlist loading and etc
+    background
+};
+
+/// Time source of `RpsLimiter`, can be replaced with a virtual clock (e.g. in tests)
+struct RpsLimiterClock
+{
+    using time_point = std::chrono::steady_clock::time_point;
+
+    static RpsLimiterClock Steady();
+
+    std::function<time_point()> now;
+    /// Blocks until `deadline` is reached or until `cv` is notified, spurious wake-ups are allowed.
+    /// `lock` is locked on entry and on exit.
+    std::function<void( std::condition_variable& cv, std::unique_lock<std::mutex>& lock, time_point deadline )> waitUntil;
+};
+
+/// Token bucket rate limiter.
+/// Interactive requests are served before background ones,
+/// unless background requests have been waiting for too long.
+///
+/// Refill rate is adjusted with AIMD: it grows slowly on every successful request
+/// and is halved (and all requests are paused) when server reports that the rate limit was reached.
 class RpsLimiter
 {
 public:
-    RpsLimiter( size_t limit, std::chrono::seconds limitPeriod = std::chrono::seconds( 1 ) );
+    /// @param limitPerSecond initial token refill rate
+    /// @param maxLimitPerSecond refill rate is never increased above this value
+    /// @param burstLimit maximum number of requests that can be sent at once after a period of inactivity
+    /// @param shouldLogDebug log throttling and rate changes
+    RpsLimiter( AbortManager& abortManager,
+                size_t limitPerSecond,
+                size_t maxLimitPerSecond,
+                size_t burstLimit,
+                bool shouldLogDebug,
+                RpsLimiterClock clock = RpsLimiterClock::Steady() );
     ~RpsLimiter() = default;
 
-    void WaitForRequestAvailability( abort_callback& abort );
+    void WaitForRequestAvailability( RequestPriority priority, abort_callback& abort );
+
+    /// Increases the rate, but only on success (2xx): errors (e.g. 5xx) must not increase it.
+    /// 429 responses should be reported via `OnRateLimited` instead.
+    void OnResponse( uint16_t statusCode );
+    /// @param retryAfter delay requested by the server, all requests are paused until it expires
+    void OnRateLimited( std::chrono::milliseconds retryAfter );
+
+private:
+    using TimePoint = RpsLimiterClock::time_point;
+
+    struct Waiter
+    {
+        TimePoint enqueueTime;
+        bool isGranted = false;
+    };
+
+    void RefillTokens( TimePoint now );
+    /// Grants available tokens to queued waiters
+    void ProcessQueue( TimePoint now );
+    std::deque<Waiter*>* SelectQueue( TimePoint now );
+    TimePoint GetNextTokenTime() const;
 
 private:
-    const bool shouldLogWebApiDebug_;
+    AbortManager& abortManager_;
+    const RpsLimiterClock clock_;
+    const bool shouldLogDebug_;
 
-    const std::chrono::seconds limitPeriod_;
+    const double maxTokensPerSecond_;
+    const double maxTokens_;
 
     std::mutex mutex_;
     std::condition_variable cv_;
 
-    std::vector<std::chrono::milliseconds> timeStampsContainer_;
-    nonstd::ring_span<
-        std::chrono::milliseconds,
-        nonstd::null_popper<std::chrono::milliseconds>>
-        timeStamps_;
+    double tokensPerSecond_;
+    double tokens_;
+    /// might be in the future when requests are paused
+    TimePoint lastRefillTime_;
 
-    size_t curRequestIdx_ = 0;
-    // TODO: replace list with queue
-    std::list<size_t> incomingRequests_;
+    std::deque<Waiter*> interactiveQueue_;
+    std::deque<Waiter*> backgroundQueue_;
+    size_t interactiveGrantsInRow_ = 0;
 };
 
 } // namespace sptf
@@ -0,0 +1,209 @@
+// Benchmark for `WebApi_JsonFilter`.
+// A playlist tracks page (100 items, as returned without `fields` parameter) is parsed with and without the filter.
+// Deserialized objects are checked to be the same, and then both parsers are timed and their allocations are counted.
+//
+// Build and run from the repository root (submodules must be checked out):
+//   g++ -std=c++17 -O2 -Itests/json_filter/stub -Ifoo_spotify -Isubmodules/fmt/include -Isubmodules/json/include -Isubmodules/span/include tests/json_filter/json_filter_benchmark.cpp foo_spotify/backend/webapi_json_filter.cpp foo_spotify/backend/webapi_objects/*.cpp -o json_filter_benchmark
+//   ./json_filter_benchmark tests/json_filter/playlist_tracks_page.json
+
+#include <stdafx.h>
+
+#include <backend/webapi_json_filter.h>
+#include <backend/webapi_objects/webapi_media_objects.h>
+#include <backend/webapi_objects/webapi_paging_object.h>
+#include <utils/json_std_extenders.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <string>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+namespace
+{
+
+size_t g_allocationCount = 0;
+size_t g_allocatedBytes = 0;
+
+} // namespace
+
+// all the allocations of the benchmark are counted: it is single-threaded, so plain counters are enough
+
+void* operator new( size_t size )
+{
+    ++g_allocationCount;
+    g_allocatedBytes += size;
+    if ( void* p = std::malloc( size ? size : 1 ) )
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete( void* p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+    ::operator delete( p );
+}
+
+namespace
+{
+
+using namespace sptf;
+
+using ParserFn = std::function<nlohmann::json( nonstd::span<const uint8_t> )>;
+
+/// Same filter as the one used for playlist track pages in `WebApi_Backend`
+std::string GetPlaylistPageFieldsFilter()
+{
+    return GetFieldsFilter( static_cast<const WebApi_PagingObject*>( nullptr ),
+                            GetFieldsFilter( static_cast<const WebApi_PlaylistTrack*>( nullptr ) ) );
+}
+
+/// Deserializes the page the same way as `WebApi_Backend::ProcessPlaylistPage`
+std::vector<std::unique_ptr<WebApi_PlaylistTrack>> Deserialize( const nlohmann::json& pageJson )
+{
+    const auto pPage = pageJson.get<std::shared_ptr<const WebApi_PagingObject>>();
+    return pPage->items.get<std::vector<std::unique_ptr<WebApi_PlaylistTrack>>>();
+}
+
+/// @return true if the filtered response produces the same objects as the unfiltered one
+bool IsCorrect( const ParserFn& parseFiltered, nonstd::span<const uint8_t> data )
+{
+    const auto unfilteredJson = nlohmann::json::parse( data.begin(), data.end() );
+    const auto filteredJson = parseFiltered( data );
+
+    const auto unfilteredPage = unfilteredJson.get<WebApi_PagingObject>();
+    const auto filteredPage = filteredJson.get<WebApi_PagingObject>();
+    if ( filteredPage.items.size() != unfilteredPage.items.size()
+         || std::tie( filteredPage.limit, filteredPage.next, filteredPage.offset, filteredPage.previous, filteredPage.total )
+                != std::tie( unfilteredPage.limit, unfilteredPage.next, unfilteredPage.offset, unfilteredPage.previous, unfilteredPage.total ) )
+    {
+        std::cout << "paging object fields do not match\n";
+        return false;
+    }
+
+    const auto unfilteredTracks = Deserialize( unfilteredJson );
+    const auto filteredTracks = Deserialize( filteredJson );
+    for ( size_t i = 0; i < unfilteredTracks.size(); ++i )
+    {
+        // `to_json` skips `restrictions`, so they are compared separately
+        const auto getRestriction = []( const auto& pPlaylistTrack ) -> std::string {
+            const auto pTrack = std::get_if<WebApi_Track>( pPlaylistTrack->track.get() );
+            return ( pTrack && pTrack->restrictions ? ( *pTrack->restrictions )->reason : "" );
+        };
+        if ( nlohmann::json( *filteredTracks[i] ) != nlohmann::json( *unfilteredTracks[i] )
+             || getRestriction( filteredTracks[i] ) != getRestriction( unfilteredTracks[i] ) )
+        {
+            std::cout << fmt::format( "item #{} does not match\n", i );
+            return false;
+        }
+    }
+
+    // sanity check: the filter should actually skip something
+    const auto& firstTrack = filteredJson.at( "items" ).at( 0 ).at( "track" );
+    if ( firstTrack.contains( "available_markets" ) || firstTrack.at( "album" ).contains( "available_markets" ) )
+    {
+        std::cout << "unused fields were not skipped\n";
+        return false;
+    }
+
+    return true;
+}
+
+struct Stats
+{
+    double usPerPage;
+    size_t allocationCount;
+    size_t allocatedBytes;
+};
+
+/// @return time (best of several runs) and allocations for a single page
+Stats Measure( const std::function<void()>& fn )
+{
+    constexpr size_t kRunCount = 7;
+    constexpr size_t kIterationCount = 20;
+
+    const auto allocationCountBefore = g_allocationCount;
+    const auto allocatedBytesBefore = g_allocatedBytes;
+    fn();
+    Stats stats{ std::numeric_limits<double>::max(), g_allocationCount - allocationCountBefore, g_allocatedBytes - allocatedBytesBefore };
+
+    for ( size_t run = 0; run < kRunCount; ++run )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for ( size_t i = 0; i < kIterationCount; ++i )
+        {
+            fn();
+        }
+        const auto elapsed = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - start ).count();
+        stats.usPerPage = std::min( stats.usPerPage, elapsed / kIterationCount );
+    }
+
+    return stats;
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+    const auto path = ( argc > 1 ? argv[1] : "tests/json_filter/playlist_tracks_page.json" );
+    std::ifstream file( path, std::ios::binary );
+    if ( !file )
+    {
+        std::cout << fmt::format( "failed to open `{}`\n", path );
+        return 1;
+    }
+    const std::vector<uint8_t> data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+
+    const WebApi_JsonFilter filter( GetPlaylistPageFieldsFilter() );
+    const ParserFn parseUnfiltered = []( nonstd::span<const uint8_t> data ) { return nlohmann::json::parse( data.begin(), data.end() ); };
+    const ParserFn parseFiltered = [&]( nonstd::span<const uint8_t> data ) { return filter.Parse( data ); };
+
+    if ( !IsCorrect( parseFiltered, data ) )
+    {
+        return 1;
+    }
+
+    struct Case
+    {
+        const char* name;
+        const ParserFn& parse;
+        bool shouldDeserialize;
+    };
+    const std::vector<Case> cases{
+        { "unfiltered", parseUnfiltered, false },
+        { "filtered", parseFiltered, false },
+        { "unfiltered + objects", parseUnfiltered, true },
+        { "filtered + objects", parseFiltered, true },
+    };
+
+    std::printf( "page: %zu bytes\n", data.size() );
+    std::printf( "%-22s%12s%14s%14s\n", "", "us/page", "allocations", "KiB allocated" );
+    for ( const auto& [name, parse, shouldDeserialize]: cases )
+    {
+        const auto stats = Measure( [&, &parse = parse, shouldDeserialize = shouldDeserialize] {
+            const auto json = parse( data );
+            if ( shouldDeserialize )
+            {
+                Deserialize( json );
+            }
+        } );
+        std::printf( "%-22s%12.0f%14zu%14zu\n", name, stats.usPerPage, stats.allocationCount, stats.allocatedBytes / 1024 );
+    }
+
+    return 0;
+}
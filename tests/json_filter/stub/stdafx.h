@@ -0,0 +1,52 @@
+#pragma once
+
+// Minimal replacement of the component precompiled header:
+// provides only the parts that are used by `WebApi_JsonFilter` and Web API objects.
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include <utils/json_macro_fix.h>
+
+#include <cassert>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace qwr
+{
+
+class QwrException : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+
+    template <typename... Args>
+    static void ExpectTrue( bool checkValue, std::string_view errorMessage, Args&&... errorMessageFmtArgs )
+    {
+        if ( !checkValue )
+        {
+            throw QwrException( fmt::format( fmt::runtime( errorMessage ), std::forward<Args>( errorMessageFmtArgs )... ) );
+        }
+    }
+};
+
+namespace unicode
+{
+
+// fixture contains only ASCII in the fields that are stored as wide strings (`next` and `previous`)
+
+inline std::wstring ToWide( const std::string& src )
+{
+    return std::wstring( src.cbegin(), src.cend() );
+}
+
+inline std::string ToU8( const std::wstring& src )
+{
+    return std::string( src.cbegin(), src.cend() );
+}
+
+} // namespace unicode
+
+} // namespace qwr
@@ -0,0 +1,300 @@
+// Tests for `LibSpotify_LoadDispatcher`.
+// libspotify is replaced by a stubbed load state: objects are loaded by the test,
+// and `metadata_updated` callback is emulated by calling `ProcessPendingLoads` under the same mutex.
+//
+// Build and run from the repository root (submodules must be checked out):
+//   g++ -std=c++17 -pthread -DFMT_HEADER_ONLY -Itests/load_dispatcher/stub -Ifoo_spotify -Isubmodules/fmt/include -Isubmodules/range/include -Isubmodules/span/include tests/load_dispatcher/load_dispatcher_test.cpp foo_spotify/backend/libspotify_load_dispatcher.cpp foo_spotify/utils/abort_manager.cpp -o load_dispatcher_test
+//   ./load_dispatcher_test
+
+#include <stdafx.h>
+
+#include <backend/libspotify_load_dispatcher.h>
+#include <utils/abort_manager.h>
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+using namespace sptf;
+
+namespace
+{
+
+/// Accessed only under the emulated libspotify mutex
+struct TestObject
+{
+    bool isLoaded = false;
+    /// number of load state checks
+    size_t checkCount = 0;
+};
+
+bool IsLoaded( void* pObject )
+{
+    auto& object = *static_cast<TestObject*>( pObject );
+    ++object.checkCount;
+    return object.isLoaded;
+}
+
+/// Runs each waiter on a separate thread
+class Harness
+{
+public:
+    Harness()
+        : dispatcher_( abortManager_, [&]( const auto& fn ) {
+            std::lock_guard lock( apiMutex_ );
+            fn();
+            ++registrationCount_;
+        } )
+    {
+    }
+
+    ~Harness()
+    {
+        for ( auto& waiter: waiters_ )
+        {
+            waiter.abort.abort();
+        }
+        for ( auto& waiter: waiters_ )
+        {
+            waiter.thread.join();
+        }
+        abortManager_.Finalize();
+    }
+
+    /// Blocks until the objects are registered
+    ///
+    /// @return waiter index
+    size_t StartWaiter( const std::vector<TestObject*>& objects )
+    {
+        const auto registrationCount = registrationCount_.load();
+
+        auto& waiter = waiters_.emplace_back();
+        waiter.objects.assign( objects.cbegin(), objects.cend() );
+        waiter.thread = std::thread( [&] {
+            try
+            {
+                dispatcher_.WaitForLoad( waiter.objects, &IsLoaded, waiter.abort );
+                waiter.status = Status::loaded;
+            }
+            catch ( const exception_aborted& )
+            {
+                waiter.status = Status::aborted;
+            }
+        } );
+
+        while ( registrationCount_ == registrationCount )
+        {
+            std::this_thread::sleep_for( 1ms );
+        }
+
+        return waiters_.size() - 1;
+    }
+
+    void Load( TestObject& object )
+    {
+        std::lock_guard lock( apiMutex_ );
+        object.isLoaded = true;
+    }
+
+    /// Same as `metadata_updated` callback, which is called from `sp_session_process_events`
+    void UpdateMetadata()
+    {
+        std::lock_guard lock( apiMutex_ );
+        dispatcher_.ProcessPendingLoads();
+    }
+
+    size_t GetCheckCount( const TestObject& object )
+    {
+        std::lock_guard lock( apiMutex_ );
+        return object.checkCount;
+    }
+
+    void Abort( size_t waiterIdx )
+    {
+        GetWaiter( waiterIdx ).abort.abort();
+    }
+
+    /// Waiter is considered to be blocked if it hasn't returned after a short while
+    ///
+    /// @return statuses of the waiters in `waiter:status` format
+    std::string GetStatuses( std::initializer_list<size_t> waiterIndices )
+    {
+        const auto deadline = std::chrono::steady_clock::now() + 50ms;
+        // abort is detected by `AbortManager` thread, which polls every 2 seconds
+        const auto abortDeadline = std::chrono::steady_clock::now() + 5s;
+
+        std::string ret;
+        for ( const auto waiterIdx: waiterIndices )
+        {
+            auto& waiter = GetWaiter( waiterIdx );
+            while ( waiter.status == Status::waiting
+                    && std::chrono::steady_clock::now() < ( waiter.abort.is_aborting() ? abortDeadline : deadline ) )
+            {
+                std::this_thread::sleep_for( 1ms );
+            }
+            ret += fmt::format( "{}{}:{}", ( ret.empty() ? "" : " " ), waiterIdx, ToString( waiter.status ) );
+        }
+        return ret;
+    }
+
+private:
+    enum class Status
+    {
+        waiting,
+        loaded,
+        aborted
+    };
+
+    struct WaiterData
+    {
+        std::vector<void*> objects;
+        abort_callback_impl abort;
+        std::thread thread;
+        std::atomic<Status> status = Status::waiting;
+    };
+
+    WaiterData& GetWaiter( size_t waiterIdx )
+    {
+        return *std::next( waiters_.begin(), waiterIdx );
+    }
+
+    static const char* ToString( Status status )
+    {
+        switch ( status )
+        {
+        case Status::waiting:
+            return "waiting";
+        case Status::loaded:
+            return "loaded";
+        case Status::aborted:
+            return "aborted";
+        default:
+            assert( false );
+            return "";
+        }
+    }
+
+private:
+    AbortManager abortManager_;
+    std::mutex apiMutex_;
+    std::atomic<size_t> registrationCount_ = 0;
+    LibSpotify_LoadDispatcher dispatcher_;
+
+    std::list<WaiterData> waiters_;
+};
+
+size_t g_failureCount = 0;
+
+void Check( std::string_view testName, std::string_view step, const std::string& actual, std::string_view expected )
+{
+    if ( actual == expected )
+    {
+        return;
+    }
+
+    ++g_failureCount;
+    std::cout << fmt::format( "{}: {}\n"
+                              "  expected: `{}`\n"
+                              "  actual:   `{}`\n",
+                              testName,
+                              step,
+                              expected,
+                              actual );
+}
+
+void TestWakeOnMetadataUpdate()
+{
+    constexpr auto kTestName = "wake on metadata update";
+    Harness h;
+
+    TestObject loaded{ true };
+    const auto w0 = h.StartWaiter( { &loaded } );
+    Check( kTestName, "loaded object is not waited for", h.GetStatuses( { w0 } ), "0:loaded" );
+
+    TestObject object;
+    const auto w1 = h.StartWaiter( { &object } );
+    h.UpdateMetadata();
+    Check( kTestName, "update without load does not wake", h.GetStatuses( { w1 } ), "1:waiting" );
+
+    h.Load( object );
+    Check( kTestName, "load without update does not wake", h.GetStatuses( { w1 } ), "1:waiting" );
+
+    h.UpdateMetadata();
+    Check( kTestName, "update after load wakes", h.GetStatuses( { w1 } ), "1:loaded" );
+
+    const auto checkCount = h.GetCheckCount( object );
+    h.UpdateMetadata();
+    Check( kTestName, "loaded object is not checked anymore", std::to_string( h.GetCheckCount( object ) ), std::to_string( checkCount ) );
+}
+
+void TestMultipleWaiters()
+{
+    constexpr auto kTestName = "multiple waiters";
+    Harness h;
+
+    TestObject a;
+    TestObject b;
+    const auto w0 = h.StartWaiter( { &a } );
+    const auto w1 = h.StartWaiter( { &a } );
+    const auto w2 = h.StartWaiter( { &a, &b } );
+    const auto w3 = h.StartWaiter( { &b } );
+
+    const auto checkCount = h.GetCheckCount( a );
+    h.UpdateMetadata();
+    Check( kTestName, "object is checked once per update", std::to_string( h.GetCheckCount( a ) - checkCount ), "1" );
+
+    h.Load( a );
+    h.UpdateMetadata();
+    Check( kTestName, "only waiters of the loaded object are woken", h.GetStatuses( { w0, w1, w2, w3 } ), "0:loaded 1:loaded 2:waiting 3:waiting" );
+
+    h.Load( b );
+    h.UpdateMetadata();
+    Check( kTestName, "waiter is woken when all of its objects are loaded", h.GetStatuses( { w2, w3 } ), "2:loaded 3:loaded" );
+}
+
+void TestAbort()
+{
+    constexpr auto kTestName = "abort";
+    Harness h;
+
+    TestObject a;
+    TestObject b;
+    const auto w0 = h.StartWaiter( { &a } );
+    const auto w1 = h.StartWaiter( { &a } );
+    const auto w2 = h.StartWaiter( { &b } );
+
+    h.Abort( w0 );
+    Check( kTestName, "aborted waiter returns", h.GetStatuses( { w0, w1 } ), "0:aborted 1:waiting" );
+
+    h.Load( a );
+    h.UpdateMetadata();
+    Check( kTestName, "other waiter of the same object is still woken", h.GetStatuses( { w1 } ), "1:loaded" );
+
+    h.Abort( w2 );
+    Check( kTestName, "last waiter of the object returns", h.GetStatuses( { w2 } ), "2:aborted" );
+
+    const auto checkCount = h.GetCheckCount( b );
+    h.UpdateMetadata();
+    Check( kTestName, "object without waiters is not checked anymore", std::to_string( h.GetCheckCount( b ) ), std::to_string( checkCount ) );
+}
+
+} // namespace
+
+int main()
+{
+    TestWakeOnMetadataUpdate();
+    TestMultipleWaiters();
+    TestAbort();
+
+    if ( g_failureCount )
+    {
+        std::cout << fmt::format( "{} check(s) failed\n", g_failureCount );
+        return 1;
+    }
+
+    std::cout << "all checks passed\n";
+    return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// Minimal replacement of the component precompiled header:
+// provides only the parts of foobar2000 SDK that are used by `LibSpotify_LoadDispatcher` and `AbortManager`.
+
+#include <fmt/format.h>
+#include <range/v3/all.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class exception_aborted : public std::exception
+{
+public:
+    const char* what() const noexcept override
+    {
+        return "User abort";
+    }
+};
+
+class abort_callback
+{
+public:
+    virtual ~abort_callback() = default;
+    virtual bool is_aborting() const = 0;
+
+    void check() const
+    {
+        if ( is_aborting() )
+        {
+            throw exception_aborted();
+        }
+    }
+};
+
+class abort_callback_impl : public abort_callback
+{
+public:
+    bool is_aborting() const override
+    {
+        return isAborting_;
+    }
+
+    void abort()
+    {
+        isAborting_ = true;
+    }
+
+private:
+    std::atomic<bool> isAborting_ = false;
+};
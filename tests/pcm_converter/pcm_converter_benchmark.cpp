@@ -0,0 +1,176 @@
+// Benchmark for `pcm::ConvertInt16ToFloat` kernels.
+// Each kernel is checked against the reference conversion and then timed over the chunk sizes delivered by libspotify.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -mavx2 -Itests/pcm_converter/stub -Ifoo_spotify tests/pcm_converter/pcm_converter_benchmark.cpp -o pcm_converter_benchmark
+//   ./pcm_converter_benchmark
+
+// kernels are defined in an anonymous namespace, so they are included directly
+#include <utils/pcm_converter.cpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+/// Per-sample conversion with byte-wise sign extension:
+/// same as the generic fixed-point path of `audio_chunk::set_data_fixedpoint`, which was used before.
+void ConvertInt16ToFloat_Reference( const int16_t* pIn, size_t count, float* pOut, float gain )
+{
+    const auto pBytes = reinterpret_cast<const uint8_t*>( pIn );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        int32_t value = pBytes[i * 2] | ( pBytes[i * 2 + 1] << 8 );
+        value = ( value ^ 0x8000 ) - 0x8000;
+        pOut[i] = static_cast<float>( value ) * ( gain * ( 1.0f / 32768.0f ) );
+    }
+}
+
+struct Kernel
+{
+    const char* name;
+    ConverterFn fn;
+    bool isSupported;
+};
+
+/// @return true if the output of `fn` matches the reference one for all int16 values and for all tail sizes
+bool IsCorrect( ConverterFn fn, float gain )
+{
+    std::vector<int16_t> in( 65536 + 31 );
+    for ( size_t i = 0; i < in.size(); ++i )
+    {
+        in[i] = static_cast<int16_t>( i );
+    }
+
+    std::vector<float> expected( in.size() );
+    std::vector<float> actual( in.size() );
+    ConvertInt16ToFloat_Reference( in.data(), in.size(), expected.data(), gain );
+
+    // unaligned starts and sizes that are not divisible by the vector width
+    for ( size_t offset = 0; offset < 16; ++offset )
+    {
+        std::fill( actual.begin(), actual.end(), -2.0f );
+        fn( in.data() + offset, in.size() - offset, actual.data(), gain );
+        if ( std::memcmp( actual.data(), expected.data() + offset, ( in.size() - offset ) * sizeof( float ) ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// @return nanoseconds per chunk (best of several runs)
+double Measure( ConverterFn fn, const std::vector<int16_t>& in, std::vector<float>& out, size_t chunkSize, float gain )
+{
+    constexpr size_t kRunCount = 7;
+
+    // about the same amount of data for every chunk size
+    const size_t iterationCount = std::max<size_t>( 1, ( 64 * 1024 * 1024 ) / chunkSize );
+    const size_t chunkCount = in.size() / chunkSize;
+
+    double best = std::numeric_limits<double>::max();
+    for ( size_t run = 0; run < kRunCount; ++run )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for ( size_t i = 0; i < iterationCount; ++i )
+        {
+            // chunks are rotated to avoid measuring the same cache lines over and over
+            const auto offset = ( i % chunkCount ) * chunkSize;
+            fn( in.data() + offset, chunkSize, out.data() + offset, gain );
+        }
+        const auto elapsed = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+        best = std::min( best, elapsed / iterationCount );
+    }
+
+    return best;
+}
+
+} // namespace
+
+int main()
+{
+    const std::vector<Kernel> kernels{
+        { "reference", &ConvertInt16ToFloat_Reference, true },
+        { "scalar", &ConvertInt16ToFloat_Scalar, true },
+        { "sse2", &ConvertInt16ToFloat_Sse2, HasSse2() },
+        { "avx2", &ConvertInt16ToFloat_Avx2, HasAvx2() },
+        { "dispatched", &sptf::pcm::ConvertInt16ToFloat, true },
+    };
+
+    // 1.0 is used when volume normalization is disabled, the rest are +3 dB and +12 dB (maximum) of normalization pre-amp
+    const std::vector<float> gains{ 1.0f, 1.4125376f, 3.9810717f };
+
+    bool hasFailed = false;
+    for ( const auto& kernel: kernels )
+    {
+        for ( const auto gain: gains )
+        {
+            if ( kernel.isSupported && !IsCorrect( kernel.fn, gain ) )
+            {
+                std::cout << kernel.name << ": output does not match the reference for gain " << gain << "\n";
+                hasFailed = true;
+            }
+        }
+    }
+    if ( hasFailed )
+    {
+        return 1;
+    }
+
+    // range of `num_frames` values in `music_delivery` calls, audio is stereo
+    constexpr size_t kChannels = 2;
+    // gain is applied in the same pass as the scaling, so its value does not affect the timings
+    constexpr float kMeasuredGain = 1.4125376f;
+    const std::vector<size_t> frameCounts{ 256, 1024, 2048, 8192 };
+
+    std::mt19937 rng( 42 );
+    std::uniform_int_distribution<int> dist( INT16_MIN, INT16_MAX );
+    // bigger than L2, so that the data is not always cached, similar to the ring buffer
+    std::vector<int16_t> in( 4 * 1024 * 1024 );
+    std::generate( in.begin(), in.end(), [&] { return static_cast<int16_t>( dist( rng ) ); } );
+    std::vector<float> out( in.size() );
+
+    std::vector<double> referenceTimes;
+    for ( const auto frameCount: frameCounts )
+    {
+        referenceTimes.emplace_back( Measure( &ConvertInt16ToFloat_Reference, in, out, frameCount * kChannels, kMeasuredGain ) );
+    }
+
+    std::printf( "%-12s", "frames" );
+    for ( const auto frameCount: frameCounts )
+    {
+        std::printf( "%16zu", frameCount );
+    }
+    std::printf( "\n" );
+
+    for ( const auto& kernel: kernels )
+    {
+        if ( !kernel.isSupported )
+        {
+            std::printf( "%-12s not supported\n", kernel.name );
+            continue;
+        }
+
+        std::printf( "%-12s", kernel.name );
+        for ( size_t i = 0; i < frameCounts.size(); ++i )
+        {
+            const auto nsPerChunk = ( kernel.fn == &ConvertInt16ToFloat_Reference
+                                          ? referenceTimes[i]
+                                          : Measure( kernel.fn, in, out, frameCounts[i] * kChannels, kMeasuredGain ) );
+            std::printf( "%9.0f ns %3.1fx", nsPerChunk, referenceTimes[i] / nsPerChunk );
+        }
+        std::printf( "\n" );
+    }
+    std::printf( "(time per chunk and speed-up relative to the reference)\n" );
+
+    return 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// Replacement of MSVC intrinsics header for GCC (11 or newer, since `__cpuidex` is required).
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+// GCC's `__cpuid` is a macro with a different signature
+#undef __cpuid
+
+inline void __cpuid( int cpuInfo[4], int leaf )
+{
+    __cpuidex( cpuInfo, leaf, 0 );
+}
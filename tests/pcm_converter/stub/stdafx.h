@@ -0,0 +1,6 @@
+#pragma once
+
+// Minimal replacement of the component precompiled header: `pcm_converter.cpp` needs only the standard headers.
+
+#include <cstddef>
+#include <cstdint>
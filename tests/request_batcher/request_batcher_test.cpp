@@ -0,0 +1,374 @@
+// Tests for `WebApi_RequestBatcher`.
+// Web API is replaced by a stubbed batch processor: requests are recorded and completed by the test.
+//
+// Build and run from the repository root (submodules must be checked out):
+//   g++ -std=c++17 -pthread -DFMT_HEADER_ONLY -Itests/request_batcher/stub -Ifoo_spotify -Isubmodules/fmt/include -Isubmodules/range/include -Isubmodules/span/include tests/request_batcher/request_batcher_test.cpp foo_spotify/backend/webapi_request_batcher.cpp foo_spotify/utils/abort_manager.cpp -o request_batcher_test
+//   ./request_batcher_test
+
+#include <stdafx.h>
+
+#include <backend/webapi_request_batcher.h>
+#include <utils/abort_manager.h>
+
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+using namespace sptf;
+
+namespace
+{
+
+constexpr auto kAbortMessage = "Abort was signaled, canceling request...";
+
+struct BatchRequest
+{
+    std::vector<std::string> ids;
+    pplx::cancellation_token token;
+    pplx::task_completion_event<void> event;
+};
+
+/// Runs each waiter on a separate thread
+class Harness
+{
+public:
+    Harness( size_t maxBatchSize, std::chrono::milliseconds window )
+        : batcher_(
+            abortManager_,
+            [&]( auto ids, auto token ) {
+                std::lock_guard lock( mutex_ );
+                auto& request = requests_.emplace_back( BatchRequest{ std::vector<std::string>( ids.begin(), ids.end() ), token } );
+                if ( std::find( ids.begin(), ids.end(), "throw" ) != ids.end() )
+                {
+                    throw std::runtime_error( "failed to start" );
+                }
+                return pplx::create_task( request.event );
+            },
+            maxBatchSize,
+            window )
+    {
+    }
+
+    ~Harness()
+    {
+        for ( auto& waiter: waiters_ )
+        {
+            waiter.abort.abort();
+        }
+        {
+            std::lock_guard lock( mutex_ );
+            for ( auto& request: requests_ )
+            { // no-op for completed requests
+                request.event.set_exception( pplx::task_canceled() );
+            }
+        }
+        for ( auto& waiter: waiters_ )
+        {
+            waiter.thread.join();
+        }
+        batcher_.Finalize();
+        abortManager_.Finalize();
+    }
+
+    /// Waits a bit, so that the waiter has a chance to join the batch
+    ///
+    /// @return waiter index
+    size_t StartWaiter( const std::string& id )
+    {
+        auto& waiter = waiters_.emplace_back();
+        waiter.thread = std::thread( [&, id] {
+            try
+            {
+                batcher_.Process( id, waiter.abort );
+                waiter.SetStatus( "done" );
+            }
+            catch ( const qwr::QwrException& e )
+            {
+                waiter.SetStatus( std::string_view( kAbortMessage ) == e.what() ? "aborted" : fmt::format( "error({})", e.what() ) );
+            }
+            catch ( const std::exception& e )
+            {
+                waiter.SetStatus( fmt::format( "error({})", e.what() ) );
+            }
+        } );
+        std::this_thread::sleep_for( 20ms );
+
+        return waiters_.size() - 1;
+    }
+
+    void Abort( size_t waiterIdx )
+    {
+        GetWaiter( waiterIdx ).abort.abort();
+    }
+
+    void Finalize()
+    {
+        batcher_.Finalize();
+    }
+
+    /// Waits for the request for a short while
+    ///
+    /// @return ids of the request or `none`
+    std::string GetRequestIds( size_t requestIdx, std::chrono::milliseconds timeout = 500ms )
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while ( true )
+        {
+            {
+                std::lock_guard lock( mutex_ );
+                if ( requestIdx < requests_.size() )
+                {
+                    return fmt::format( "{}", fmt::join( GetRequest( requestIdx ).ids, " " ) );
+                }
+            }
+            if ( std::chrono::steady_clock::now() >= deadline )
+            {
+                return "none";
+            }
+            std::this_thread::sleep_for( 1ms );
+        }
+    }
+
+    std::string IsCanceled( size_t requestIdx )
+    {
+        std::lock_guard lock( mutex_ );
+        return ( GetRequest( requestIdx ).token.is_canceled() ? "canceled" : "active" );
+    }
+
+    void Complete( size_t requestIdx )
+    {
+        GetEvent( requestIdx ).set();
+    }
+
+    template <typename E>
+    void Fail( size_t requestIdx, E error )
+    {
+        GetEvent( requestIdx ).set_exception( error );
+    }
+
+    /// Waiter is considered to be blocked if it hasn't returned after a short while
+    ///
+    /// @return statuses of the waiters in `waiter:status` format
+    std::string GetStatuses( std::initializer_list<size_t> waiterIndices )
+    {
+        const auto deadline = std::chrono::steady_clock::now() + 50ms;
+        // abort is detected by `AbortManager` thread, which polls every 2 seconds
+        const auto abortDeadline = std::chrono::steady_clock::now() + 5s;
+
+        std::string ret;
+        for ( const auto waiterIdx: waiterIndices )
+        {
+            auto& waiter = GetWaiter( waiterIdx );
+            auto status = waiter.GetStatus();
+            while ( status == "waiting"
+                    && std::chrono::steady_clock::now() < ( waiter.abort.is_aborting() ? abortDeadline : deadline ) )
+            {
+                std::this_thread::sleep_for( 1ms );
+                status = waiter.GetStatus();
+            }
+            ret += fmt::format( "{}{}:{}", ( ret.empty() ? "" : " " ), waiterIdx, status );
+        }
+        return ret;
+    }
+
+private:
+    struct WaiterData
+    {
+        abort_callback_impl abort;
+        std::thread thread;
+
+        void SetStatus( const std::string& newStatus )
+        {
+            std::lock_guard lock( mutex );
+            status = newStatus;
+        }
+
+        std::string GetStatus()
+        {
+            std::lock_guard lock( mutex );
+            return status;
+        }
+
+    private:
+        std::mutex mutex;
+        std::string status = "waiting";
+    };
+
+    WaiterData& GetWaiter( size_t waiterIdx )
+    {
+        return *std::next( waiters_.begin(), waiterIdx );
+    }
+
+    BatchRequest& GetRequest( size_t requestIdx )
+    {
+        return *std::next( requests_.begin(), requestIdx );
+    }
+
+    /// Event is completed outside of the lock, since it invokes the continuations
+    pplx::task_completion_event<void> GetEvent( size_t requestIdx )
+    {
+        std::lock_guard lock( mutex_ );
+        return GetRequest( requestIdx ).event;
+    }
+
+private:
+    AbortManager abortManager_;
+    WebApi_RequestBatcher batcher_;
+
+    std::mutex mutex_;
+    std::list<BatchRequest> requests_;
+
+    std::list<WaiterData> waiters_;
+};
+
+size_t g_failureCount = 0;
+
+void Check( std::string_view testName, std::string_view step, const std::string& actual, std::string_view expected )
+{
+    if ( actual == expected )
+    {
+        return;
+    }
+
+    ++g_failureCount;
+    std::cout << fmt::format( "{}: {}\n"
+                              "  expected: `{}`\n"
+                              "  actual:   `{}`\n",
+                              testName,
+                              step,
+                              expected,
+                              actual );
+}
+
+void TestJoin()
+{
+    constexpr auto kTestName = "join";
+    Harness h( 10, 300ms );
+
+    const auto w0 = h.StartWaiter( "a" );
+    const auto w1 = h.StartWaiter( "b" );
+    const auto w2 = h.StartWaiter( "a" );
+    Check( kTestName, "waiters within the window share a request with unique ids", h.GetRequestIds( 0 ), "a b" );
+    Check( kTestName, "waiters are blocked until the request is complete", h.GetStatuses( { w0, w1, w2 } ), "0:waiting 1:waiting 2:waiting" );
+
+    h.Complete( 0 );
+    Check( kTestName, "all waiters are woken", h.GetStatuses( { w0, w1, w2 } ), "0:done 1:done 2:done" );
+
+    const auto w3 = h.StartWaiter( "c" );
+    Check( kTestName, "started batch is not joined", h.GetRequestIds( 1 ), "c" );
+    h.Complete( 1 );
+    Check( kTestName, "new batch is processed", h.GetStatuses( { w3 } ), "3:done" );
+}
+
+void TestWindowExpiry()
+{
+    constexpr auto kTestName = "window expiry";
+    {
+        Harness h( 10, 500ms );
+
+        h.StartWaiter( "a" );
+        Check( kTestName, "request is not sent before the window expires", h.GetRequestIds( 0, 100ms ), "none" );
+        Check( kTestName, "request is sent after the window expires", h.GetRequestIds( 0, 1s ), "a" );
+    }
+    {
+        Harness h( 2, 10s );
+
+        h.StartWaiter( "a" );
+        h.StartWaiter( "a" );
+        Check( kTestName, "duplicate ids do not fill the batch", h.GetRequestIds( 0, 100ms ), "none" );
+        h.StartWaiter( "b" );
+        Check( kTestName, "full batch is sent without waiting for the window", h.GetRequestIds( 0 ), "a b" );
+        h.StartWaiter( "c" );
+        Check( kTestName, "full batch is not joined", h.GetRequestIds( 1, 100ms ), "none" );
+    }
+}
+
+void TestLastWaiterAbort()
+{
+    constexpr auto kTestName = "last waiter abort";
+    {
+        Harness h( 2, 10s );
+
+        const auto w0 = h.StartWaiter( "a" );
+        h.Abort( w0 );
+        Check( kTestName, "aborted waiter returns", h.GetStatuses( { w0 } ), "0:aborted" );
+
+        h.StartWaiter( "c" );
+        h.StartWaiter( "d" );
+        Check( kTestName, "batch without waiters is dropped before it is sent", h.GetRequestIds( 0 ), "c d" );
+    }
+    {
+        Harness h( 2, 10s );
+
+        const auto w0 = h.StartWaiter( "a" );
+        const auto w1 = h.StartWaiter( "b" );
+        Check( kTestName, "request is sent", h.GetRequestIds( 0 ), "a b" );
+
+        h.Abort( w0 );
+        Check( kTestName, "aborted waiter returns", h.GetStatuses( { w0, w1 } ), "0:aborted 1:waiting" );
+        Check( kTestName, "request is not canceled while there are waiters", h.IsCanceled( 0 ), "active" );
+
+        h.Abort( w1 );
+        Check( kTestName, "last aborted waiter returns", h.GetStatuses( { w1 } ), "1:aborted" );
+        Check( kTestName, "request is canceled when there are no waiters", h.IsCanceled( 0 ), "canceled" );
+    }
+}
+
+void TestErrorPropagation()
+{
+    constexpr auto kTestName = "error propagation";
+    {
+        Harness h( 2, 10s );
+
+        const auto w0 = h.StartWaiter( "a" );
+        const auto w1 = h.StartWaiter( "b" );
+        h.Fail( 0, std::runtime_error( "429" ) );
+        Check( kTestName, "request error is passed to all waiters", h.GetStatuses( { w0, w1 } ), "0:error(429) 1:error(429)" );
+    }
+    {
+        Harness h( 2, 10s );
+
+        const auto w0 = h.StartWaiter( "a" );
+        const auto w1 = h.StartWaiter( "b" );
+        h.Fail( 0, pplx::task_canceled() );
+        Check( kTestName, "cancellation is reported as abort", h.GetStatuses( { w0, w1 } ), "0:aborted 1:aborted" );
+    }
+    {
+        Harness h( 2, 10s );
+
+        const auto w0 = h.StartWaiter( "a" );
+        const auto w1 = h.StartWaiter( "throw" );
+        Check( kTestName, "processor error is passed to all waiters", h.GetStatuses( { w0, w1 } ), "0:error(failed to start) 1:error(failed to start)" );
+    }
+    {
+        Harness h( 2, 10s );
+
+        const auto w0 = h.StartWaiter( "a" );
+        h.Finalize();
+        Check( kTestName, "pending batch is aborted on finalize", h.GetStatuses( { w0 } ), "0:aborted" );
+        Check( kTestName, "pending batch is not sent on finalize", h.GetRequestIds( 0, 100ms ), "none" );
+    }
+}
+
+} // namespace
+
+int main()
+{
+    TestJoin();
+    TestWindowExpiry();
+    TestLastWaiterAbort();
+    TestErrorPropagation();
+
+    if ( g_failureCount )
+    {
+        std::cout << fmt::format( "{} check(s) failed\n", g_failureCount );
+        return 1;
+    }
+
+    std::cout << "all checks passed\n";
+    return 0;
+}
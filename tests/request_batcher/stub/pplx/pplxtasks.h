@@ -0,0 +1,210 @@
+#pragma once
+
+// Minimal replacement of cpprestsdk tasks: only `task<void>` and the parts that are used by `WebApi_RequestBatcher`.
+// Continuations are executed on the thread that completes the task.
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pplx
+{
+
+class task_canceled : public std::exception
+{
+public:
+    const char* what() const noexcept override
+    {
+        return "task canceled";
+    }
+};
+
+class cancellation_token
+{
+public:
+    explicit cancellation_token( std::shared_ptr<std::atomic<bool>> pIsCanceled )
+        : pIsCanceled_( std::move( pIsCanceled ) )
+    {
+    }
+
+    static cancellation_token none()
+    {
+        return cancellation_token( std::make_shared<std::atomic<bool>>( false ) );
+    }
+
+    bool is_canceled() const
+    {
+        return *pIsCanceled_;
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> pIsCanceled_;
+};
+
+class cancellation_token_source
+{
+public:
+    cancellation_token get_token() const
+    {
+        return cancellation_token( pIsCanceled_ );
+    }
+
+    void cancel() const
+    {
+        *pIsCanceled_ = true;
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> pIsCanceled_ = std::make_shared<std::atomic<bool>>( false );
+};
+
+namespace details
+{
+
+class TaskState
+{
+public:
+    /// Only the first completion has an effect
+    void Complete( std::exception_ptr pError )
+    {
+        std::vector<std::function<void()>> continuations;
+        {
+            std::lock_guard lock( mutex_ );
+            if ( isDone_ )
+            {
+                return;
+            }
+            isDone_ = true;
+            pError_ = pError;
+            continuations.swap( continuations_ );
+        }
+        cv_.notify_all();
+
+        for ( const auto& continuation: continuations )
+        {
+            continuation();
+        }
+    }
+
+    void AddContinuation( std::function<void()> continuation )
+    {
+        {
+            std::lock_guard lock( mutex_ );
+            if ( !isDone_ )
+            {
+                continuations_.emplace_back( std::move( continuation ) );
+                return;
+            }
+        }
+        continuation();
+    }
+
+    void Wait()
+    {
+        std::unique_lock lock( mutex_ );
+        cv_.wait( lock, [&] { return isDone_; } );
+    }
+
+    std::exception_ptr GetError()
+    {
+        std::lock_guard lock( mutex_ );
+        return pError_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool isDone_ = false;
+    std::exception_ptr pError_;
+    std::vector<std::function<void()>> continuations_;
+};
+
+} // namespace details
+
+template <typename T>
+class task;
+
+template <>
+class task<void>
+{
+public:
+    task() = default;
+
+    explicit task( std::shared_ptr<details::TaskState> pState )
+        : pState_( std::move( pState ) )
+    {
+    }
+
+    void wait() const
+    {
+        pState_->Wait();
+    }
+
+    void get() const
+    {
+        pState_->Wait();
+        if ( auto pError = pState_->GetError() )
+        {
+            std::rethrow_exception( pError );
+        }
+    }
+
+    /// @param fn void( task<void> )
+    template <typename Fn>
+    task<void> then( Fn fn ) const
+    {
+        auto pNextState = std::make_shared<details::TaskState>();
+        pState_->AddContinuation( [fn, self = *this, pNextState] {
+            try
+            {
+                fn( self );
+                pNextState->Complete( nullptr );
+            }
+            catch ( ... )
+            {
+                pNextState->Complete( std::current_exception() );
+            }
+        } );
+        return task<void>( pNextState );
+    }
+
+private:
+    std::shared_ptr<details::TaskState> pState_;
+};
+
+template <typename T>
+class task_completion_event;
+
+template <>
+class task_completion_event<void>
+{
+public:
+    bool set() const
+    {
+        pState_->Complete( nullptr );
+        return true;
+    }
+
+    template <typename E>
+    bool set_exception( E error ) const
+    {
+        pState_->Complete( std::make_exception_ptr( error ) );
+        return true;
+    }
+
+    friend task<void> create_task( const task_completion_event<void>& event );
+
+private:
+    std::shared_ptr<details::TaskState> pState_ = std::make_shared<details::TaskState>();
+};
+
+inline task<void> create_task( const task_completion_event<void>& event )
+{
+    return task<void>( event.pState_ );
+}
+
+} // namespace pplx
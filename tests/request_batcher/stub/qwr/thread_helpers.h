@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string_view>
+#include <thread>
+
+namespace qwr
+{
+
+inline void SetThreadName( std::thread&, std::string_view )
+{
+}
+
+} // namespace qwr
@@ -0,0 +1,51 @@
+#pragma once
+
+// Minimal replacement of the component precompiled header:
+// provides only the parts of foobar2000 SDK and fb2k_utils that are used by `WebApi_RequestBatcher` and `AbortManager`.
+
+#include <fmt/format.h>
+#include <range/v3/all.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class abort_callback
+{
+public:
+    virtual ~abort_callback() = default;
+    virtual bool is_aborting() const = 0;
+};
+
+class abort_callback_impl : public abort_callback
+{
+public:
+    bool is_aborting() const override
+    {
+        return isAborting_;
+    }
+
+    void abort()
+    {
+        isAborting_ = true;
+    }
+
+private:
+    std::atomic<bool> isAborting_ = false;
+};
+
+namespace qwr
+{
+
+class QwrException : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+} // namespace qwr
@@ -0,0 +1,140 @@
+// Size of a playlist tracks page (100 items) with and without `Accept-Encoding: gzip` and `fields` parameter.
+// Server-side behaviour is reproduced locally: `fields` response is the recorded full one pruned by the same filter
+// that `WebApi_Backend` sends, and the compressed response is its gzip encoding (zlib with default settings).
+// Also measures the time that the client spends on decompression.
+//
+// Uses the stub and the recorded response of the `json_filter` benchmark.
+// Build and run from the repository root (submodules must be checked out):
+//   g++ -std=c++17 -O2 -Itests/json_filter/stub -Ifoo_spotify -Isubmodules/fmt/include -Isubmodules/json/include -Isubmodules/span/include tests/response_size/response_size_benchmark.cpp foo_spotify/backend/webapi_json_filter.cpp foo_spotify/backend/webapi_objects/*.cpp -lz -o response_size_benchmark
+//   ./response_size_benchmark tests/json_filter/playlist_tracks_page.json
+
+#include <stdafx.h>
+
+#include <backend/webapi_json_filter.h>
+#include <backend/webapi_objects/webapi_media_objects.h>
+#include <backend/webapi_objects/webapi_paging_object.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using namespace sptf;
+
+/// Same filter as the one used for playlist track pages in `WebApi_Backend`
+std::string GetPlaylistPageFieldsFilter()
+{
+    return GetFieldsFilter( static_cast<const WebApi_PagingObject*>( nullptr ),
+                            GetFieldsFilter( static_cast<const WebApi_PlaylistTrack*>( nullptr ) ) );
+}
+
+/// @return gzip stream, same as the body of the response with `Content-Encoding: gzip`
+std::vector<uint8_t> Compress( const std::vector<uint8_t>& data )
+{
+    z_stream stream{};
+    // 16 - gzip header instead of zlib one
+    qwr::QwrException::ExpectTrue( Z_OK == deflateInit2( &stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY ),
+                                   "deflateInit2 failed" );
+
+    std::vector<uint8_t> compressed( deflateBound( &stream, static_cast<uLong>( data.size() ) ) );
+    stream.next_in = const_cast<Bytef*>( data.data() );
+    stream.avail_in = static_cast<uInt>( data.size() );
+    stream.next_out = compressed.data();
+    stream.avail_out = static_cast<uInt>( compressed.size() );
+    const auto ret = deflate( &stream, Z_FINISH );
+    compressed.resize( stream.total_out );
+    deflateEnd( &stream );
+
+    qwr::QwrException::ExpectTrue( Z_STREAM_END == ret, "deflate failed: {}", ret );
+    return compressed;
+}
+
+std::vector<uint8_t> Decompress( const std::vector<uint8_t>& compressed, size_t size )
+{
+    z_stream stream{};
+    qwr::QwrException::ExpectTrue( Z_OK == inflateInit2( &stream, 16 + MAX_WBITS ), "inflateInit2 failed" );
+
+    std::vector<uint8_t> data( size );
+    stream.next_in = const_cast<Bytef*>( compressed.data() );
+    stream.avail_in = static_cast<uInt>( compressed.size() );
+    stream.next_out = data.data();
+    stream.avail_out = static_cast<uInt>( data.size() );
+    const auto ret = inflate( &stream, Z_FINISH );
+    inflateEnd( &stream );
+
+    qwr::QwrException::ExpectTrue( Z_STREAM_END == ret && stream.total_out == size, "inflate failed: {}", ret );
+    return data;
+}
+
+/// @return microseconds (best of several runs)
+double MeasureDecompression( const std::vector<uint8_t>& compressed, size_t size )
+{
+    constexpr size_t kRunCount = 7;
+    constexpr size_t kIterationCount = 20;
+
+    double best = std::numeric_limits<double>::max();
+    for ( size_t run = 0; run < kRunCount; ++run )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for ( size_t i = 0; i < kIterationCount; ++i )
+        {
+            Decompress( compressed, size );
+        }
+        const auto elapsed = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - start ).count();
+        best = std::min( best, elapsed / kIterationCount );
+    }
+
+    return best;
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+    const auto path = ( argc > 1 ? argv[1] : "tests/json_filter/playlist_tracks_page.json" );
+    std::ifstream file( path, std::ios::binary );
+    if ( !file )
+    {
+        std::cout << fmt::format( "failed to open `{}`\n", path );
+        return 1;
+    }
+    const std::vector<uint8_t> full( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+
+    const WebApi_JsonFilter filter( GetPlaylistPageFieldsFilter() );
+    const auto filteredDump = filter.Parse( full ).dump();
+    const std::vector<uint8_t> filtered( filteredDump.cbegin(), filteredDump.cend() );
+
+    const auto fullCompressed = Compress( full );
+    const auto filteredCompressed = Compress( filtered );
+    if ( Decompress( fullCompressed, full.size() ) != full || Decompress( filteredCompressed, filtered.size() ) != filtered )
+    {
+        std::cout << "decompressed data does not match the original\n";
+        return 1;
+    }
+
+    std::printf( "%-16s%10s%8s%14s\n", "", "bytes", "ratio", "inflate us" );
+    const auto printRow = [&]( const char* name, size_t size, double inflateUs ) {
+        std::printf( "%-16s%10zu%7.1f%%", name, size, 100.0 * size / full.size() );
+        if ( inflateUs > 0 )
+        {
+            std::printf( "%14.0f", inflateUs );
+        }
+        std::printf( "\n" );
+    };
+    printRow( "full", full.size(), 0 );
+    printRow( "full + gzip", fullCompressed.size(), MeasureDecompression( fullCompressed, full.size() ) );
+    printRow( "fields", filtered.size(), 0 );
+    printRow( "fields + gzip", filteredCompressed.size(), MeasureDecompression( filteredCompressed, filtered.size() ) );
+
+    return 0;
+}
@@ -0,0 +1,436 @@
+// Scheduling tests for `RpsLimiter`.
+// Time is controlled by a virtual clock, so the results don't depend on the speed of the machine.
+//
+// Build and run from the repository root (submodules must be checked out):
+//   g++ -std=c++17 -pthread -DFMT_HEADER_ONLY -Itests/rps_limiter/stub -Ifoo_spotify -Isubmodules/fb2k_utils/src -Isubmodules/fmt/include -Isubmodules/range/include tests/rps_limiter/rps_limiter_test.cpp foo_spotify/utils/rps_limiter.cpp foo_spotify/utils/abort_manager.cpp -o rps_limiter_test
+//   ./rps_limiter_test
+
+#include <stdafx.h>
+
+#include <utils/abort_manager.h>
+#include <utils/rps_limiter.h>
+
+#include <chrono>
+#include <list>
+#include <map>
+#include <string>
+
+using namespace std::literals::chrono_literals;
+using namespace sptf;
+
+namespace
+{
+
+using TimePoint = RpsLimiterClock::time_point;
+
+/// Time is changed only by `Advance`.
+///
+/// Waiters are woken up on every `Advance`. Each of them registers the current epoch when it goes back to sleep,
+/// which allows to wait until the limiter has processed the new time (see `IsWaitingInCurrentEpoch`).
+class VirtualClock
+{
+public:
+    RpsLimiterClock Get()
+    {
+        return RpsLimiterClock{
+            [this] { return Now(); },
+            [this]( std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TimePoint ) {
+                Wait( cv, lock );
+            }
+        };
+    }
+
+    TimePoint Now()
+    {
+        std::lock_guard lock( mutex_ );
+        return now_;
+    }
+
+    std::chrono::milliseconds Elapsed()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>( Now() - TimePoint{} );
+    }
+
+    void Advance( std::chrono::milliseconds duration )
+    {
+        std::mutex* pLimiterMutex = nullptr;
+        std::condition_variable* pLimiterCv = nullptr;
+        {
+            std::lock_guard lock( mutex_ );
+            pLimiterMutex = pLimiterMutex_;
+            pLimiterCv = pLimiterCv_;
+        }
+
+        // limiter checks the time under its own lock: taking it here ensures that the wake-up is not lost
+        std::unique_lock<std::mutex> limiterLock;
+        if ( pLimiterMutex )
+        {
+            limiterLock = std::unique_lock( *pLimiterMutex );
+        }
+        {
+            std::lock_guard lock( mutex_ );
+            now_ += duration;
+            ++epoch_;
+        }
+        if ( pLimiterCv )
+        {
+            pLimiterCv->notify_all();
+        }
+    }
+
+    bool IsWaitingInCurrentEpoch( std::thread::id threadId )
+    {
+        std::lock_guard lock( mutex_ );
+        const auto it = waiterEpochs_.find( threadId );
+        return ( it != waiterEpochs_.cend() && it->second == epoch_ );
+    }
+
+    void ForgetWaiter( std::thread::id threadId )
+    {
+        std::lock_guard lock( mutex_ );
+        waiterEpochs_.erase( threadId );
+    }
+
+private:
+    void Wait( std::condition_variable& cv, std::unique_lock<std::mutex>& limiterLock )
+    {
+        {
+            std::lock_guard lock( mutex_ );
+            pLimiterMutex_ = limiterLock.mutex();
+            pLimiterCv_ = &cv;
+            waiterEpochs_[std::this_thread::get_id()] = epoch_;
+        }
+        cv.wait( limiterLock );
+    }
+
+private:
+    std::mutex mutex_;
+    TimePoint now_;
+    size_t epoch_ = 0;
+    std::map<std::thread::id, size_t> waiterEpochs_;
+    std::mutex* pLimiterMutex_ = nullptr;
+    std::condition_variable* pLimiterCv_ = nullptr;
+};
+
+/// Runs each request on a separate thread and records the (virtual) time when it was granted
+class Harness
+{
+public:
+    Harness( size_t limitPerSecond, size_t maxLimitPerSecond, size_t burstLimit )
+        : limiter_( abortManager_, limitPerSecond, maxLimitPerSecond, burstLimit, false, clock_.Get() )
+    {
+    }
+
+    ~Harness()
+    {
+        // unblock the remaining requests
+        for ( auto& request: requests_ )
+        {
+            request.abort.abort();
+        }
+        for ( auto& request: requests_ )
+        {
+            request.thread.join();
+        }
+        abortManager_.Finalize();
+    }
+
+    RpsLimiter& Limiter()
+    {
+        return limiter_;
+    }
+
+    /// Blocks until the request is either granted or queued
+    void Request( const std::string& name, RequestPriority priority )
+    {
+        auto& request = requests_.emplace_back();
+        request.name = name;
+        request.thread = std::thread( [&, priority] {
+            limiter_.WaitForRequestAvailability( priority, request.abort );
+            const auto grantTime = clock_.Elapsed();
+            clock_.ForgetWaiter( std::this_thread::get_id() );
+            {
+                std::lock_guard lock( grantsMutex_ );
+                if ( !request.abort.is_aborting() )
+                {
+                    grants_.emplace_back( request.name, grantTime );
+                }
+            }
+            request.isDone = true;
+        } );
+
+        WaitUntilSettled();
+    }
+
+    /// Blocks until the limiter has processed the new time
+    void Advance( std::chrono::milliseconds duration )
+    {
+        clock_.Advance( duration );
+        WaitUntilSettled();
+    }
+
+    /// @return grants since the previous call in the grant order, each one as `name@milliseconds`
+    std::string TakeGrants()
+    {
+        std::lock_guard lock( grantsMutex_ );
+        std::string ret;
+        for ( const auto& [name, time]: grants_ )
+        {
+            ret += fmt::format( "{}{}@{}", ( ret.empty() ? "" : " " ), name, time.count() );
+        }
+        grants_.clear();
+        return ret;
+    }
+
+private:
+    struct RequestData
+    {
+        std::string name;
+        abort_callback_impl abort;
+        std::thread thread;
+        std::atomic<bool> isDone = false;
+    };
+
+    /// All the grants for the current time are made by the first waiter that wakes up,
+    /// so the limiter is settled when every request is either done or went back to sleep.
+    void WaitUntilSettled()
+    {
+        const auto isSettled = [&] {
+            return std::all_of( requests_.begin(), requests_.end(), [&]( auto& request ) {
+                return ( request.isDone || clock_.IsWaitingInCurrentEpoch( request.thread.get_id() ) );
+            } );
+        };
+        while ( !isSettled() )
+        {
+            std::this_thread::sleep_for( 1ms );
+        }
+    }
+
+private:
+    AbortManager abortManager_;
+    VirtualClock clock_;
+    RpsLimiter limiter_;
+
+    std::list<RequestData> requests_;
+
+    std::mutex grantsMutex_;
+    std::vector<std::pair<std::string, std::chrono::milliseconds>> grants_;
+};
+
+size_t g_failureCount = 0;
+
+void Check( std::string_view testName, std::string_view step, const std::string& actual, std::string_view expected )
+{
+    if ( actual == expected )
+    {
+        return;
+    }
+
+    ++g_failureCount;
+    std::cout << fmt::format( "{}: {}\n"
+                              "  expected: `{}`\n"
+                              "  actual:   `{}`\n",
+                              testName,
+                              step,
+                              expected,
+                              actual );
+}
+
+void TestTokenRefill()
+{
+    constexpr auto kTestName = "token refill";
+    Harness h( 2, 2, 3 );
+
+    for ( const auto& name: { "a", "b", "c", "d" } )
+    {
+        h.Request( name, RequestPriority::background );
+    }
+    Check( kTestName, "burst is served right away", h.TakeGrants(), "a@0 b@0 c@0" );
+
+    h.Advance( 400ms );
+    Check( kTestName, "token is not refilled yet", h.TakeGrants(), "" );
+
+    h.Advance( 100ms );
+    Check( kTestName, "token is refilled at limit rate", h.TakeGrants(), "d@500" );
+
+    h.Advance( 10s );
+    for ( const auto& name: { "e", "f", "g", "h" } )
+    {
+        h.Request( name, RequestPriority::background );
+    }
+    Check( kTestName, "refill is capped by burst limit", h.TakeGrants(), "e@10500 f@10500 g@10500" );
+
+    h.Advance( 500ms );
+    Check( kTestName, "waiter is served after burst", h.TakeGrants(), "h@11000" );
+}
+
+void TestInteractivePriority()
+{
+    constexpr auto kTestName = "interactive priority";
+    Harness h( 1, 1, 1 );
+
+    h.Request( "b1", RequestPriority::background );
+    h.Request( "b2", RequestPriority::background );
+    h.Request( "i1", RequestPriority::interactive );
+    h.Request( "b3", RequestPriority::background );
+    h.Request( "i2", RequestPriority::interactive );
+    Check( kTestName, "first request is served right away", h.TakeGrants(), "b1@0" );
+
+    h.Advance( 1s );
+    h.Advance( 1s );
+    Check( kTestName, "interactive requests are served first", h.TakeGrants(), "i1@1000 i2@2000" );
+
+    h.Advance( 1s );
+    h.Advance( 1s );
+    Check( kTestName, "background requests are served in order", h.TakeGrants(), "b2@3000 b3@4000" );
+}
+
+void TestStarvationByGrantCount()
+{
+    constexpr auto kTestName = "starvation by grant count";
+    // faster rate, so that the background request doesn't reach the wait limit
+    Harness h( 2, 2, 1 );
+
+    h.Request( "x", RequestPriority::background );
+    h.Request( "b", RequestPriority::background );
+    for ( const auto& name: { "i1", "i2", "i3", "i4", "i5" } )
+    {
+        h.Request( name, RequestPriority::interactive );
+    }
+    h.TakeGrants();
+
+    for ( size_t i = 0; i < 6; ++i )
+    {
+        h.Advance( 500ms );
+    }
+    Check( kTestName, "background request is served after 4 interactive ones", h.TakeGrants(), "i1@500 i2@1000 i3@1500 i4@2000 b@2500 i5@3000" );
+}
+
+void TestStarvationByWaitTime()
+{
+    constexpr auto kTestName = "starvation by wait time";
+    Harness h( 2, 2, 1 );
+
+    h.Request( "x", RequestPriority::background );
+    h.Request( "b", RequestPriority::background );
+    h.Request( "i", RequestPriority::interactive );
+    h.TakeGrants();
+
+    // rate is halved to 1 request per second, next token is available at 7s
+    h.Limiter().OnRateLimited( 6s );
+    h.Advance( 6500ms );
+    Check( kTestName, "requests are paused", h.TakeGrants(), "" );
+
+    h.Advance( 500ms );
+    Check( kTestName, "background request is served after waiting for 5 seconds", h.TakeGrants(), "b@7000" );
+
+    h.Advance( 1s );
+    Check( kTestName, "interactive request is served next", h.TakeGrants(), "i@8000" );
+}
+
+void TestRateIncrease()
+{
+    constexpr auto kTestName = "rate increase";
+    Harness h( 1, 10, 1 );
+
+    h.Request( "x", RequestPriority::background );
+    h.TakeGrants();
+
+    for ( const uint16_t statusCode: { 100, 304, 404, 429, 500 } )
+    {
+        h.Limiter().OnResponse( statusCode );
+    }
+    h.Request( "a", RequestPriority::background );
+    h.Advance( 999ms );
+    h.Advance( 1ms );
+    Check( kTestName, "non-2xx responses do not change the rate", h.TakeGrants(), "a@1000" );
+
+    // 1 + 0.5 / 1 requests per second
+    h.Limiter().OnResponse( 200 );
+    h.Request( "b", RequestPriority::background );
+    h.Advance( 600ms );
+    h.Advance( 100ms );
+    Check( kTestName, "2xx response increases the rate", h.TakeGrants(), "b@1700" );
+}
+
+void TestRateDecrease()
+{
+    constexpr auto kTestName = "rate decrease";
+    Harness h( 4, 10, 1 );
+
+    h.Request( "x", RequestPriority::background );
+    h.TakeGrants();
+
+    // requests that were sent concurrently report the same pause
+    h.Limiter().OnRateLimited( 1s );
+    h.Limiter().OnRateLimited( 1s );
+    h.Request( "a", RequestPriority::background );
+    h.Advance( 1400ms );
+    h.Advance( 100ms );
+    Check( kTestName, "rate is halved once per pause", h.TakeGrants(), "a@1500" );
+
+    h.Limiter().OnRateLimited( 1s );
+    h.Request( "b", RequestPriority::background );
+    h.Advance( 1900ms );
+    h.Advance( 100ms );
+    Check( kTestName, "rate is halved on the next pause", h.TakeGrants(), "b@3500" );
+}
+
+void TestRateLimits()
+{
+    constexpr auto kTestName = "rate limits";
+    {
+        Harness h( 1, 10, 1 );
+
+        h.Request( "x", RequestPriority::background );
+        h.TakeGrants();
+
+        // 1 -> 0.5 -> 0.25 -> 0.125 -> 0.1 -> 0.1
+        for ( size_t i = 0; i < 5; ++i )
+        {
+            h.Limiter().OnRateLimited( 1s );
+            h.Advance( 1s );
+        }
+        h.Request( "a", RequestPriority::background );
+        h.Advance( 9999ms );
+        h.Advance( 1ms );
+        Check( kTestName, "rate is not decreased below 0.1 requests per second", h.TakeGrants(), "a@15000" );
+    }
+    {
+        Harness h( 8, 10, 1 );
+
+        h.Request( "x", RequestPriority::background );
+        h.TakeGrants();
+
+        for ( size_t i = 0; i < 100; ++i )
+        {
+            h.Limiter().OnResponse( 200 );
+        }
+        h.Request( "a", RequestPriority::background );
+        h.Advance( 99ms );
+        h.Advance( 1ms );
+        Check( kTestName, "rate is not increased above the max limit", h.TakeGrants(), "a@100" );
+    }
+}
+
+} // namespace
+
+int main()
+{
+    TestTokenRefill();
+    TestInteractivePriority();
+    TestStarvationByGrantCount();
+    TestStarvationByWaitTime();
+    TestRateIncrease();
+    TestRateDecrease();
+    TestRateLimits();
+
+    if ( g_failureCount )
+    {
+        std::cout << fmt::format( "{} check(s) failed\n", g_failureCount );
+        return 1;
+    }
+
+    std::cout << "all checks passed\n";
+    return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Minimal replacement of the component precompiled header:
+// provides only the parts of foobar2000 SDK that are used by `RpsLimiter` and `AbortManager`.
+
+#include <fmt/format.h>
+#include <range/v3/all.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define SPTF_UNDERSCORE_NAME "foo_spotify"
+
+class abort_callback
+{
+public:
+    virtual ~abort_callback() = default;
+    virtual bool is_aborting() const = 0;
+};
+
+class abort_callback_impl : public abort_callback
+{
+public:
+    bool is_aborting() const override
+    {
+        return isAborting_;
+    }
+
+    void abort()
+    {
+        isAborting_ = true;
+    }
+
+private:
+    std::atomic<bool> isAborting_ = false;
+};
+
+inline std::ostream& FB2K_console_formatter()
+{
+    return std::cout << '\n';
+}